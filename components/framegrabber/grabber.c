@@ -5,6 +5,7 @@
 
 // cstdlib includes
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 // TFT includes
@@ -13,11 +14,16 @@
 // FreeRTOS includes
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 
 // WEBCLIENT includes
 #include "webclient/client.h"
 
+// STATS includes
+#include "stats/stats.h"
+
 // ESP-IDF includes
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "sdkconfig.h"
 #include "driver/gpio.h"
@@ -27,36 +33,204 @@
  ****************************************************************/
 #define FRAME_WIDTH					(128)
 #define FRAME_HEIGHT				(160)
-#define BYTES_PER_PIXEL				(3)
+// Frames are requested in the display's native pixel format and pushed as-is
+#define BYTES_PER_PIXEL				(TFT_PIXEL_BYTES)
+#if TFT_COLOR_BITS == 16
+#define FRAME_FORMAT				"rgb565"
+#else
+#define FRAME_FORMAT				"rgb888"
+#endif
 #define FRAME_BUFFER_SIZE			(FRAME_WIDTH * FRAME_HEIGHT * BYTES_PER_PIXEL)
 
+// Delta frames: the server sends only the rectangles that changed since
+// the frame the device last received. Response layout (little endian):
+//   uint32 length		total response length, including this header
+//   uint16 frameId		id of the frame this delta produces
+//   uint16 rectCount	number of rectangles that follow (0 = no change),
+//						or'ed with DELTA_ENCODED if every rectangle carries its data size
+//   rectCount * { uint16 x, y, w, h; [uint32 size]; data[size], padded to 4 bytes }
+// Pixels are FRAME_FORMAT, rgb565 being big endian as sent to the display.
+// Requesting base frame 0 makes the server send the whole frame as one rectangle.
+#define USE_DELTA_FRAMES			(1)
+#define DELTA_HEADER_SIZE			(8)
+#define DELTA_RECT_HEADER_SIZE		(8)
+#define DELTA_ENCODED_HEADER_SIZE	(12)
+#define DELTA_ENCODED				(0x8000)
+#define DELTA_MAX_RECTS				(16)
+
+// Run length encoded frames: requested by adding "rle" to the frame request.
+// Data of a rectangle (or the whole frame without delta frames) is either raw pixels,
+// if its size is exactly w * h * BYTES_PER_PIXEL, or a sequence of packets:
+//   uint8 n < 128		n + 1 pixels follow
+//   uint8 n >= 128		the next pixel is repeated n - 125 times (3 ~ 130)
+// The server sends raw pixels whenever encoding would not make the data smaller.
+#define USE_RLE_FRAMES				(1)
+#define RLE_REPEAT					(0x80)
+#define RLE_MIN_REPEAT				(3)
+#if USE_RLE_FRAMES
+#define FRAME_OPTIONS				" rle"
+#else
+#define FRAME_OPTIONS				""
+#endif
+
+// JPEG frames: requested with "widget_get_frame jpeg", the response being a baseline
+// JPEG image. It is decoded and drawn by the receive task while it is still arriving,
+// reading in order from the framed transport's reassembly buffer in a free slot.
+#define USE_JPEG_FRAMES				(0)
+
+// Band frames (low memory mode): every frame is requested in bands of FRAME_BAND_LINES lines with
+// "widget_get_rows <y> <lines> FRAME_FORMAT", the server answering with the pixels of the frame it
+// rendered for the band at y = 0. Bands are received straight into the display's DMA buffers
+// within one address window, each one being sent while the next is received, so no frame slots
+// are allocated. FRAME_BAND_LINES is limited by the display's row buffer (ROWS_BUF_BYTES).
+#define USE_BAND_FRAMES				(0)
+#define FRAME_BAND_LINES			(8)
+
+// Pushed frames: instead of polling every FRAME_PERIOD_MS the device subscribes once with
+// "widget_subscribe <credits> <lastFrameId> FRAME_FORMAT[ rle]" and the server pushes delta
+// frames over the framed transport as the content changes. Each pushed frame uses up one
+// credit, the device granting one more with "credit 1" whenever it has a free slot to receive
+// the next frame into, so frames are never pushed faster than they are drawn. Subscribing
+// again replaces the server's credits and delta base; it is repeated every PUSH_RENEW_MS
+// without a frame, and after losing a pushed frame.
+#define USE_PUSH_FRAMES				(0)
+#define PUSH_CREDITS				(1)
+#define PUSH_RENEW_MS				(5000)
+
+#if USE_PUSH_FRAMES && !USE_DELTA_FRAMES
+#error "Pushed frames are delta frames, set USE_DELTA_FRAMES"
+#endif
+
+#if USE_BAND_FRAMES
+#define FRAME_SLOT_SIZE				(0)
+#elif USE_DELTA_FRAMES
+#define FRAME_SLOT_SIZE				(DELTA_HEADER_SIZE + (DELTA_MAX_RECTS * DELTA_ENCODED_HEADER_SIZE) + FRAME_BUFFER_SIZE)
+#else
+#define FRAME_SLOT_SIZE				(FRAME_BUFFER_SIZE)
+#endif
+
+// Frames drawn by the receive task as they arrive, rather than handed to the display task
+#define FRAME_DRAWN_ON_RECEIVE		(USE_JPEG_FRAMES || USE_BAND_FRAMES)
+
+#define FRAME_SLOTS					(2)
+
+// Frame slots are received into directly and handed to the SPI DMA
+// descriptors as they are, so they must come from DMA capable memory
+#ifndef FRAME_SLOT_ALLOC
+#define FRAME_SLOT_ALLOC(size)		heap_caps_malloc((size), MALLOC_CAP_DMA)
+#endif
+
 #define GRABBER_TASK_STACK			(8192)
+#define DISPLAY_TASK_STACK			(4096)
 
 #define RESPONSE_BUFFER_SIZE		(32)
+#define REQUEST_BUFFER_SIZE			(48)
 
 #define FRAME_PERIOD_MS				(40)
 #define MAX_FAILS					(5)
 
+// Every this many received frames the stats are logged and sent to the server as "stats <summary>"
+#define STATS_REPORT_FRAMES			(250)
+#define STATS_BUFFER_SIZE			(512)
+
+/****************************************************************
+ * Typedefs, structs, enums
+ ****************************************************************/
+// Run length decoder state, kept between row blocks
+typedef struct
+{
+	const uint8_t * src;
+	const uint8_t * end;
+	uint16_t width;
+	uint8_t count;						// pixels left in the current packet
+	bool repeat;
+	bool error;
+	uint8_t pixel[BYTES_PER_PIXEL];
+	uint64_t time;
+} rle_state_t;
+
+// Band receive state, kept between bands of a frame
+typedef struct
+{
+	uint16_t y;
+	bool error;
+} band_state_t;
+
 /****************************************************************
  * Local variables
  ****************************************************************/
-char regionData[FRAME_BUFFER_SIZE];
+char * regionData[FRAME_SLOTS];
+size_t regionSize[FRAME_SLOTS];
+uint64_t regionStart[FRAME_SLOTS];
+uint16_t lastFrameId = 0;
+QueueHandle_t freeSlots;
+QueueHandle_t readySlots;
 bool frameGrabberRunning = false;
 bool disconnected = false;
 uint8_t fails = 0;
+uint16_t framesSinceReport = 0;
+bool subscribed = false;
+bool creditOwed = false;
+volatile bool baseLost = false;
+uint64_t lastPush = 0;
 
 /****************************************************************
  * Function declarations
  ****************************************************************/
 void FrameGrabber_Task(void * pvParameter);
 
+void FrameGrabber_DisplayTask(void * pvParameter);
+
 bool FrameGrabber_SendMessage(char * message);
 
+bool FrameGrabber_Receive(uint8_t slot);
+
+bool FrameGrabber_CheckBase();
+
+bool FrameGrabber_CheckDelta(uint8_t slot);
+
+bool FrameGrabber_Subscribe();
+
+bool FrameGrabber_ReceivePushed(uint8_t slot);
+
+bool FrameGrabber_ReceiveJpeg(uint8_t slot);
+
+bool FrameGrabber_ReceiveBands(uint8_t slot);
+
+void FrameGrabber_ReceiveBand(uint8_t * buf, int y, int rows, void * arg);
+
+uint32_t FrameGrabber_ReadJpeg(uint8_t * buf, uint32_t len, void * arg);
+
+void FrameGrabber_ReportStats();
+
+bool FrameGrabber_Draw(uint8_t slot);
+
+void FrameGrabber_DecodeRows(uint8_t * buf, int y, int rows, void * arg);
+
+bool FrameGrabber_DrawEncoded(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t * data, size_t size);
+
 /****************************************************************
  * Function definitions
  ****************************************************************/
 bool FrameGrabber_Init()
 {
+	uint8_t slot;
+
+	freeSlots = xQueueCreate(FRAME_SLOTS, sizeof(uint8_t));
+	readySlots = xQueueCreate(FRAME_SLOTS, sizeof(uint8_t));
+	if ((freeSlots == NULL) || (readySlots == NULL)) return false;
+
+	Stats_Reset();
+
+	for (slot = 0; slot < FRAME_SLOTS; slot++)
+	{
+#if FRAME_SLOT_SIZE > 0
+		regionData[slot] = FRAME_SLOT_ALLOC(FRAME_SLOT_SIZE);
+		if (regionData[slot] == NULL) return false;
+#endif
+		xQueueSend(freeSlots, &slot, 0);
+	}
+
 	TFT_fillScreen(TFT_BLACK);
 	_fg = TFT_WHITE;
 	_fg = TFT_BLACK;
@@ -67,6 +241,7 @@ bool FrameGrabber_Init()
 
 bool FrameGrabber_Run()
 {
+	xTaskCreate(FrameGrabber_DisplayTask, "FrameGrabber_DisplayTask", DISPLAY_TASK_STACK, NULL, 10, NULL);
 	xTaskCreate(FrameGrabber_Task, "FrameGrabber_Task", GRABBER_TASK_STACK, NULL, 10, NULL);
 	frameGrabberRunning = true;
 	return true;
@@ -105,15 +280,373 @@ bool FrameGrabber_SendMessage(char * message)
 	}
 }
 
+bool FrameGrabber_Receive(uint8_t slot)
+{
+#if USE_BAND_FRAMES
+	return FrameGrabber_ReceiveBands(slot);
+#elif USE_PUSH_FRAMES
+	return FrameGrabber_ReceivePushed(slot);
+#elif USE_DELTA_FRAMES
+	char request[REQUEST_BUFFER_SIZE];
+
+	FrameGrabber_CheckBase();
+	snprintf(request, sizeof(request), "widget_get_delta %u " FRAME_FORMAT FRAME_OPTIONS, lastFrameId);
+	if (WebClient_GetFramed(request, FRAME_SLOT_SIZE, regionData[slot], &regionSize[slot]) == false)
+	{
+		return false;
+	}
+
+	return FrameGrabber_CheckDelta(slot);
+#else
+	if (WebClient_GetFramed("widget_get_frame " FRAME_FORMAT FRAME_OPTIONS, FRAME_BUFFER_SIZE, regionData[slot], &regionSize[slot]) == false)
+	{
+		return false;
+	}
+#if USE_RLE_FRAMES
+	return (regionSize[slot] > 0);
+#else
+	return (regionSize[slot] == FRAME_BUFFER_SIZE);
+#endif
+#endif
+}
+
+// Drops the delta base after a failed draw so the next frame is sent in full;
+// done from the receive task, which owns lastFrameId
+bool FrameGrabber_CheckBase()
+{
+	if (baseLost == false) return false;
+
+	baseLost = false;
+	lastFrameId = 0;
+	return true;
+}
+
+// Validates the delta frame in a slot and makes it the base of the next one
+bool FrameGrabber_CheckDelta(uint8_t slot)
+{
+	uint32_t length;
+	uint16_t frameId;
+
+	memcpy(&length, &regionData[slot][0], sizeof(length));
+	memcpy(&frameId, &regionData[slot][4], sizeof(frameId));
+	if ((length < DELTA_HEADER_SIZE) || (length != regionSize[slot]))
+	{
+		return false;
+	}
+
+	lastFrameId = frameId;
+	return true;
+}
+
+// Sent without waiting for an answer, as it could be mistaken for a pushed packet;
+// a lost subscription is renewed after PUSH_RENEW_MS
+bool FrameGrabber_Subscribe()
+{
+	char request[REQUEST_BUFFER_SIZE];
+
+	snprintf(request, sizeof(request), "widget_subscribe %u %u " FRAME_FORMAT FRAME_OPTIONS, PUSH_CREDITS, lastFrameId);
+	WebClient_ResetPush();
+	subscribed = WebClient_Send(request);
+	creditOwed = false;
+	lastPush = Stats_Now();
+	return subscribed;
+}
+
+// Waits for the server to push the next frame into the slot
+bool FrameGrabber_ReceivePushed(uint8_t slot)
+{
+	framed_stream_t stream;
+
+	while (1)
+	{
+		if (FrameGrabber_CheckBase()) subscribed = false;
+
+		if ((subscribed == false) || ((Stats_Now() - lastPush) > (PUSH_RENEW_MS * 1000ULL)))
+		{
+			if (FrameGrabber_Subscribe() == false) return false;
+		}
+		else if (creditOwed)
+		{
+			// The previous frame is in, this slot is free for the next one
+			if (WebClient_Send("credit 1")) creditOwed = false;
+		}
+
+		WebClient_ListenFramed(&stream, FRAME_SLOT_SIZE, regionData[slot]);
+		while ((WebClient_FramedDone(&stream) == false) && WebClient_PumpFramed(&stream));
+
+		if (WebClient_CloseFramed(&stream, &regionSize[slot]))
+		{
+			regionStart[slot] = stream.startTime;
+			lastPush = Stats_Now();
+			creditOwed = true;
+			if (FrameGrabber_CheckDelta(slot)) return true;
+			subscribed = false;
+			return false;
+		}
+		if (stream.chunkCount > 0)
+		{
+			// Lost a frame and with it a credit and the delta base
+			subscribed = false;
+			return false;
+		}
+		// Nothing pushed yet
+	}
+}
+
+// Receives and draws a JPEG frame at the same time, using the slot as the receive buffer
+bool FrameGrabber_ReceiveJpeg(uint8_t slot)
+{
+	framed_stream_t stream;
+	bool result;
+
+	if (WebClient_OpenFramed(&stream, "widget_get_frame jpeg", FRAME_SLOT_SIZE, regionData[slot]) == false)
+	{
+		return false;
+	}
+
+	result = (TFT_jpg_stream(0, 0, 0, FrameGrabber_ReadJpeg, &stream) != 0);
+
+	// The decoder stops at the end of the image, receive whatever follows it
+	while (WebClient_ReadFramed(&stream, NULL, FRAMED_CHUNK_SIZE) > 0);
+	if (WebClient_CloseFramed(&stream, &regionSize[slot]) == false)
+	{
+		return false;
+	}
+
+	if (result)
+	{
+		Stats_RecordSince(STATS_STAGE_FRAME, regionStart[slot]);
+		Stats_Add(STATS_COUNTER_FRAMES, 1);
+	}
+	return result;
+}
+
+uint32_t FrameGrabber_ReadJpeg(uint8_t * buf, uint32_t len, void * arg)
+{
+	return WebClient_ReadFramed((framed_stream_t *)arg, (char *)buf, len);
+}
+
+// Receives and draws a frame band by band, in one address window
+bool FrameGrabber_ReceiveBands(uint8_t slot)
+{
+	band_state_t state;
+
+	state.y = 0;
+	state.error = false;
+	TFT_pushBands(dispWin.x1, dispWin.y1, dispWin.x1 + FRAME_WIDTH - 1, dispWin.y1 + FRAME_HEIGHT - 1,
+			FRAME_BAND_LINES, FrameGrabber_ReceiveBand, &state);
+	if ((state.error) || (state.y != FRAME_HEIGHT)) return false;
+
+	Stats_Add(STATS_COUNTER_SPI_BYTES, FRAME_BUFFER_SIZE);
+	Stats_RecordSince(STATS_STAGE_FRAME, regionStart[slot]);
+	Stats_Add(STATS_COUNTER_FRAMES, 1);
+	return true;
+}
+
+// Receives the next band into the display's DMA buffer while the previous one is being sent
+void FrameGrabber_ReceiveBand(uint8_t * buf, int y, int rows, void * arg)
+{
+	band_state_t * state = (band_state_t *)arg;
+	char request[REQUEST_BUFFER_SIZE];
+	size_t size = rows * FRAME_WIDTH * BYTES_PER_PIXEL;
+	size_t received = 0;
+
+	if (state->error == false)
+	{
+		snprintf(request, sizeof(request), "widget_get_rows %u %u " FRAME_FORMAT, state->y, rows);
+		if ((WebClient_GetFramed(request, size, (char *)buf, &received) == false) || (received != size))
+		{
+			// Skip the rest of the frame, the window still has to be filled
+			state->error = true;
+		}
+	}
+	if (state->error) memset(buf, 0, size);
+	state->y += rows;
+}
+
+// Returns false if part of the frame could not be drawn
+bool FrameGrabber_Draw(uint8_t slot)
+{
+	bool drawn = true;
+
+	// Conversion time is recorded per frame, leave out anything drawn before it
+	TFT_takeConvertTime();
+
+#if USE_DELTA_FRAMES
+	uint8_t * data = (uint8_t *)regionData[slot];
+	size_t offset = DELTA_HEADER_SIZE;
+	size_t headerSize = DELTA_RECT_HEADER_SIZE;
+	uint16_t rectCount;
+	uint16_t rect[4];
+	size_t pixelBytes;
+	uint32_t dataSize;
+	uint64_t spiStart = Stats_Now();
+
+	memcpy(&rectCount, &data[6], sizeof(rectCount));
+	if (rectCount & DELTA_ENCODED)
+	{
+		rectCount &= ~DELTA_ENCODED;
+		headerSize = DELTA_ENCODED_HEADER_SIZE;
+	}
+
+	while (rectCount-- > 0)
+	{
+		drawn = false;
+		if ((offset + headerSize) > regionSize[slot]) break;
+		memcpy(rect, &data[offset], sizeof(rect));
+
+		pixelBytes = rect[2] * rect[3] * BYTES_PER_PIXEL;
+		dataSize = pixelBytes;
+		if (headerSize == DELTA_ENCODED_HEADER_SIZE) memcpy(&dataSize, &data[offset + DELTA_RECT_HEADER_SIZE], sizeof(dataSize));
+		offset += headerSize;
+
+		if (((rect[0] + rect[2]) > FRAME_WIDTH) || ((rect[1] + rect[3]) > FRAME_HEIGHT)) break;
+		if ((offset + dataSize) > regionSize[slot]) break;
+
+		if (dataSize == pixelBytes)
+		{
+			// Sent by DMA while the next rectangle is parsed
+			TFT_submitRect(rect[0], rect[1], rect[2], rect[3], &data[offset], NULL, NULL);
+		}
+		else if (FrameGrabber_DrawEncoded(rect[0], rect[1], rect[2], rect[3], &data[offset], dataSize) == false)
+		{
+			break;
+		}
+		Stats_Add(STATS_COUNTER_SPI_BYTES, pixelBytes);
+		offset += (dataSize + 3) & ~3;
+		drawn = true;
+	}
+#else
+	uint64_t spiStart = Stats_Now();
+
+	if (regionSize[slot] == FRAME_BUFFER_SIZE)
+	{
+		TFT_submitRect(0, 0, FRAME_WIDTH, FRAME_HEIGHT, (uint8_t *)regionData[slot], NULL, NULL);
+	}
+	else
+	{
+		drawn = FrameGrabber_DrawEncoded(0, 0, FRAME_WIDTH, FRAME_HEIGHT, (uint8_t *)regionData[slot], regionSize[slot]);
+	}
+	Stats_Add(STATS_COUNTER_SPI_BYTES, FRAME_BUFFER_SIZE);
+#endif
+
+	// The slot may be reused once everything has been sent
+	TFT_flushAsync();
+
+	Stats_Record(STATS_STAGE_CONVERT, TFT_takeConvertTime());
+	Stats_RecordSince(STATS_STAGE_SPI, spiStart);
+	Stats_RecordSince(STATS_STAGE_FRAME, regionStart[slot]);
+	Stats_Add(STATS_COUNTER_FRAMES, 1);
+	return drawn;
+}
+
+// Decodes the next 'rows' rows of a run length encoded rectangle into the
+// display's DMA buffer, packets may continue from one call to the next
+void FrameGrabber_DecodeRows(uint8_t * buf, int y, int rows, void * arg)
+{
+	rle_state_t * state = (rle_state_t *)arg;
+	uint32_t left = rows * state->width;
+	uint32_t n;
+	uint64_t start = Stats_Now();
+
+	while (left > 0)
+	{
+		if (state->count == 0)
+		{
+			// Next packet
+			if (state->src >= state->end) break;
+			if (*state->src & RLE_REPEAT)
+			{
+				state->count = (*state->src++ & ~RLE_REPEAT) + RLE_MIN_REPEAT;
+				state->repeat = true;
+				if ((state->src + BYTES_PER_PIXEL) > state->end) break;
+				memcpy(state->pixel, state->src, BYTES_PER_PIXEL);
+				state->src += BYTES_PER_PIXEL;
+			}
+			else
+			{
+				state->count = *state->src++ + 1;
+				state->repeat = false;
+			}
+		}
+
+		n = (state->count < left) ? state->count : left;
+		if (state->repeat)
+		{
+			for (uint32_t i = 0; i < n; i++)
+			{
+				memcpy(buf, state->pixel, BYTES_PER_PIXEL);
+				buf += BYTES_PER_PIXEL;
+			}
+		}
+		else
+		{
+			if ((state->src + (n * BYTES_PER_PIXEL)) > state->end) break;
+			memcpy(buf, state->src, n * BYTES_PER_PIXEL);
+			state->src += n * BYTES_PER_PIXEL;
+			buf += n * BYTES_PER_PIXEL;
+		}
+		state->count -= n;
+		left -= n;
+	}
+
+	if (left > 0)
+	{
+		// Truncated data, the rest of the rectangle is left black
+		memset(buf, 0, left * BYTES_PER_PIXEL);
+		state->error = true;
+	}
+	state->time += Stats_Now() - start;
+}
+
+// Decodes a run length encoded rectangle straight into the display's DMA buffers,
+// each block of rows is sent while the next one is decoded
+bool FrameGrabber_DrawEncoded(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t * data, size_t size)
+{
+	rle_state_t state;
+
+	memset(&state, 0, sizeof(state));
+	state.src = data;
+	state.end = data + size;
+	state.width = w;
+
+	TFT_pushRows(dispWin.x1 + x, dispWin.y1 + y, dispWin.x1 + x + w - 1, dispWin.y1 + y + h - 1, FrameGrabber_DecodeRows, &state);
+	Stats_Record(STATS_STAGE_DECODE, (uint32_t)state.time);
+
+	return (state.error == false);
+}
+
+void FrameGrabber_ReportStats()
+{
+	char buffer[STATS_BUFFER_SIZE];
+	size_t len;
+
+	len = snprintf(buffer, sizeof(buffer), "stats ");
+	Stats_Format(&buffer[len], sizeof(buffer) - len);
+	ESP_LOGI("FrameGrabber", "%s", buffer);
+	WebClient_Send(buffer);
+}
+
+// Receives frames into free slots and hands them to the display task,
+// so the next frame is fetched while the previous one is still being drawn
 void FrameGrabber_Task(void * pvParameter)
 {
+	TickType_t lastWake = xTaskGetTickCount();
+	uint8_t slot;
+
 	while (1)
 	{
-		uint8_t i;
-		color_t * colorData = &regionData;
+		xQueueReceive(freeSlots, &slot, portMAX_DELAY);
 
-		if (WebClient_Get("widget_get_frame", FRAME_BUFFER_SIZE, regionData) == false)
+		regionStart[slot] = Stats_Now();
+#if USE_JPEG_FRAMES
+		if (FrameGrabber_ReceiveJpeg(slot) == false)
+#else
+		if (FrameGrabber_Receive(slot) == false)
+#endif
 		{
+			Stats_Add(STATS_COUNTER_DROPPED, 1);
+			xQueueSend(freeSlots, &slot, 0);
 			if (++fails >= MAX_FAILS)
 			{
 				gpio_set_level(PIN_NUM_BCKL, PIN_BCKL_OFF);
@@ -122,13 +655,44 @@ void FrameGrabber_Task(void * pvParameter)
 		else
 		{
 			fails = 0;
+#if FRAME_DRAWN_ON_RECEIVE
+			// Already drawn
 			gpio_set_level(PIN_NUM_BCKL, PIN_BCKL_ON);
-			for (i = 0; i < FRAME_HEIGHT; i++)
+			xQueueSend(freeSlots, &slot, 0);
+#else
+			xQueueSend(readySlots, &slot, portMAX_DELAY);
+#endif
+
+			// Sent from this task so it never interleaves with a frame request
+			if (++framesSinceReport >= STATS_REPORT_FRAMES)
 			{
-				TFT_drawFastHLineBuffer(0, i, FRAME_WIDTH, colorData + (FRAME_WIDTH * i));
+				framesSinceReport = 0;
+				FrameGrabber_ReportStats();
 			}
 		}
 
-		vTaskDelay(FRAME_PERIOD_MS / portTICK_PERIOD_MS);
+#if !USE_PUSH_FRAMES
+		vTaskDelayUntil(&lastWake, FRAME_PERIOD_MS / portTICK_PERIOD_MS);
+#endif
+	}
+}
+
+// Draws received frames and returns their slots to the receive task
+void FrameGrabber_DisplayTask(void * pvParameter)
+{
+	uint8_t slot;
+
+	while (1)
+	{
+		xQueueReceive(readySlots, &slot, portMAX_DELAY);
+
+		gpio_set_level(PIN_NUM_BCKL, PIN_BCKL_ON);
+		if (FrameGrabber_Draw(slot) == false)
+		{
+			// The screen no longer matches the delta base, the receive task asks for a full frame
+			baseLost = true;
+		}
+
+		xQueueSend(freeSlots, &slot, portMAX_DELAY);
 	}
 }
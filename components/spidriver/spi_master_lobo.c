@@ -87,6 +87,8 @@ Main driver's function is 'spi_lobo_transfer_data()'
 
 static spi_lobo_host_t *spihost[3] = {NULL};
 
+static void spi_lobo_queue_free(spi_lobo_queue_t *queue);
+
 
 static const char *SPI_TAG = "spi_lobo_master";
 #define SPI_CHECK(a, str, ret_val) \
@@ -521,6 +523,7 @@ static esp_err_t spi_lobo_bus_free(spi_lobo_host_device_t host, int dofree)
     spi_lobo_periph_free(host);
 
     if (dofree) {
+		if (spihost[host]->intr) esp_intr_free(spihost[host]->intr);
 		vSemaphoreDelete(spihost[host]->spi_lobo_bus_mutex);
 	    free(spihost[host]->dmadesc_tx);
 	    free(spihost[host]->dmadesc_rx);
@@ -629,6 +632,11 @@ esp_err_t spi_lobo_bus_remove_device(spi_lobo_device_handle_t handle)
     for (x=0; x<NO_DEV; x++) {
         if (handle->host->device[x] == handle) handle->host->device[x]=NULL;
     }
+    if (handle->queue) {
+        esp_intr_free(handle->host->intr);
+        handle->host->intr = NULL;
+        spi_lobo_queue_free(handle->queue);
+    }
 	
 	// Check if all devices are removed from this host and free the bus if yes
 	for (x=0; x<NO_DEV; x++) {
@@ -908,6 +916,208 @@ void spi_lobo_get_native_pins(int host, int *sdi, int *sdo, int *sck)
 	*sck = io_signal[host].spiclk_native;
 }
 
+//-----------------------------------------------------
+static void spi_lobo_queue_free(spi_lobo_queue_t *queue)
+{
+    if (queue == NULL) return;
+    if (queue->free_sem) vSemaphoreDelete(queue->free_sem);
+    if (queue->idle_sem) vSemaphoreDelete(queue->idle_sem);
+    free(queue->dmadesc);
+    free(queue->ring);
+    free(queue);
+}
+
+//-----------------------------------------------------------------------------------------------------------
+esp_err_t spi_lobo_device_intr_alloc(spi_lobo_device_handle_t handle, intr_handler_t handler, void *arg)
+{
+	if ((handle == NULL) || (handler == NULL)) return ESP_ERR_INVALID_ARG;
+
+	spi_lobo_host_t *host=(spi_lobo_host_t*)handle->host;
+	if (host->intr) return ESP_ERR_INVALID_STATE;
+
+	// Polled transfers must not raise the interrupt, the user enables it only when needed
+	host->hw->slave.trans_inten=0;
+	host->hw->slave.trans_done=0;
+
+	return esp_intr_alloc(io_signal[handle->host_dev].irq, 0, handler, arg, &host->intr);
+}
+
+// ==== Queued transactions ======================================================================
+
+//---------------------------------------------------------------
+static void IRAM_ATTR spi_lobo_queue_dma_reset(spi_lobo_host_t *host)
+{
+    //Tell common code DMA workaround that our DMA channel is idle. If needed, the code will do a DMA reset.
+    spi_lobo_dmaworkaround_idle(host->dma_chan);
+
+    // Reset DMA
+    host->hw->dma_conf.val |= SPI_OUT_RST|SPI_IN_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST;
+    host->hw->dma_out_link.start=0;
+    host->hw->dma_in_link.start=0;
+    host->hw->dma_conf.val &= ~(SPI_OUT_RST|SPI_IN_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST);
+    host->hw->dma_conf.out_data_burst_en=1;
+}
+
+// Start sending queue entry, the spi bus must be idle
+//-------------------------------------------------------------------------------------------------
+static void IRAM_ATTR spi_lobo_queue_start(spi_lobo_device_handle_t handle, spi_lobo_queue_entry_t *entry)
+{
+    spi_lobo_host_t *host=(spi_lobo_host_t*)handle->host;
+    spi_lobo_transaction_t *trans = &entry->trans;
+
+    if (handle->queue->pre_cb) handle->queue->pre_cb(trans);
+
+    host->hw->user.usr_mosi_highpart=0;
+    host->hw->user.usr_mosi=1;
+    host->hw->user.usr_miso=0;
+    host->hw->miso_dlen.usr_miso_dbitlen=0;
+    host->hw->mosi_dlen.usr_mosi_dbitlen=trans->length-1;
+
+    if (entry->dmadesc) {
+        spi_lobo_dmaworkaround_transfer_active(host->dma_chan);
+        host->hw->dma_out_link.addr=(int)(entry->dmadesc) & 0xFFFFF;
+        host->hw->dma_out_link.start=1;
+    }
+    else {
+        // Load the spi buffer
+        const uint8_t *txbuffer = (trans->flags & LB_SPI_TRANS_USE_TXDATA) ? trans->tx_data : (const uint8_t *)trans->tx_buffer;
+        uint32_t len = trans->length / 8;
+        uint32_t wd;
+        for (uint32_t n=0; n<len; n+=4) {
+            wd = 0;
+            for (uint32_t b=0; ((b<4) && ((n+b)<len)); b++) {
+                wd |= (uint32_t)txbuffer[n+b] << (b*8);
+            }
+            host->hw->data_buf[n/4] = wd;
+        }
+    }
+    host->hw->cmd.usr=1;
+}
+
+// 'transaction done' interrupt: complete the current transaction and start the next one
+//------------------------------------------------------
+static void IRAM_ATTR spi_lobo_queue_isr(void *arg)
+{
+    spi_lobo_device_handle_t handle = (spi_lobo_device_handle_t)arg;
+    spi_lobo_host_t *host=(spi_lobo_host_t*)handle->host;
+    spi_lobo_queue_t *queue = handle->queue;
+    spi_lobo_queue_entry_t *entry;
+    BaseType_t woken = pdFALSE;
+
+    if (!host->hw->slave.trans_done) return;
+    host->hw->slave.trans_done=0;
+    if (!queue->busy) return;
+
+    entry = &queue->ring[queue->tail];
+    if (entry->dmadesc) spi_lobo_queue_dma_reset(host);
+    if (queue->post_cb) queue->post_cb(&entry->trans);
+
+    portENTER_CRITICAL_ISR(&queue->mux);
+    queue->tail = (queue->tail + 1) % queue->depth;
+    if (queue->tail != queue->head) {
+        spi_lobo_queue_start(handle, &queue->ring[queue->tail]);
+    }
+    else {
+        host->hw->slave.trans_inten=0;
+        queue->busy = false;
+        xSemaphoreGiveFromISR(queue->idle_sem, &woken);
+    }
+    portEXIT_CRITICAL_ISR(&queue->mux);
+
+    xSemaphoreGiveFromISR(queue->free_sem, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------
+esp_err_t spi_lobo_queue_init(spi_lobo_device_handle_t handle, int depth, spi_lobo_transaction_cb_t pre_cb, spi_lobo_transaction_cb_t post_cb)
+{
+    if ((handle == NULL) || (depth < 1)) return ESP_ERR_INVALID_ARG;
+    if ((handle->queue) || (handle->host->dma_chan == 0)) return ESP_ERR_INVALID_STATE;
+
+    spi_lobo_queue_t *queue = calloc(1, sizeof(spi_lobo_queue_t));
+    if (queue == NULL) return ESP_ERR_NO_MEM;
+
+    queue->depth = depth;
+    queue->desc_ct = handle->host->max_transfer_sz / SPI_MAX_DMA_LEN;
+    queue->pre_cb = pre_cb;
+    queue->post_cb = post_cb;
+    queue->mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    queue->ring = calloc(depth, sizeof(spi_lobo_queue_entry_t));
+    queue->dmadesc = heap_caps_malloc(sizeof(lldesc_t) * queue->desc_ct * depth, MALLOC_CAP_DMA);
+    // one entry is always left empty to tell a full ring from an empty one
+    queue->free_sem = xSemaphoreCreateCounting(depth-1, depth-1);
+    queue->idle_sem = xSemaphoreCreateBinary();
+    if ((!queue->ring) || (!queue->dmadesc) || (!queue->free_sem) || (!queue->idle_sem)) goto nomem;
+
+    handle->queue = queue;
+    esp_err_t ret = spi_lobo_device_intr_alloc(handle, spi_lobo_queue_isr, handle);
+    if (ret != ESP_OK) {
+        handle->queue = NULL;
+        spi_lobo_queue_free(queue);
+        return ret;
+    }
+    return ESP_OK;
+
+nomem:
+    spi_lobo_queue_free(queue);
+    return ESP_ERR_NO_MEM;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+esp_err_t IRAM_ATTR spi_lobo_queue_trans(spi_lobo_device_handle_t handle, spi_lobo_transaction_t *trans, TickType_t ticks_to_wait)
+{
+    if ((handle == NULL) || (handle->queue == NULL) || (trans == NULL)) return ESP_ERR_INVALID_ARG;
+
+    spi_lobo_host_t *host=(spi_lobo_host_t*)handle->host;
+    spi_lobo_queue_t *queue = handle->queue;
+    uint32_t len = trans->length / 8;
+
+    if ((len == 0) || ((trans->length % 8) != 0) || (len > host->max_transfer_sz)) return ESP_ERR_INVALID_ARG;
+    if ((trans->flags & LB_SPI_TRANS_USE_TXDATA) && (len > 4)) return ESP_ERR_INVALID_ARG;
+    if (!(trans->flags & LB_SPI_TRANS_USE_TXDATA) && (trans->tx_buffer == NULL)) return ESP_ERR_INVALID_ARG;
+
+    if (!(xSemaphoreTake(queue->free_sem, ticks_to_wait))) return ESP_ERR_TIMEOUT;
+
+    // Only this task writes 'head', the entry is not visible to the interrupt until 'head' is advanced
+    int idx = queue->head;
+    spi_lobo_queue_entry_t *entry = &queue->ring[idx];
+    memcpy(&entry->trans, trans, sizeof(spi_lobo_transaction_t));
+    if (len > LB_SPI_QUEUE_DIRECT_MAX) {
+        entry->dmadesc = &queue->dmadesc[idx * queue->desc_ct];
+        spi_lobo_setup_dma_desc_links(entry->dmadesc, len, (const uint8_t *)trans->tx_buffer, false);
+    }
+    else entry->dmadesc = NULL;
+
+    portENTER_CRITICAL(&queue->mux);
+    queue->head = (idx + 1) % queue->depth;
+    if (!queue->busy) {
+        // Queue was idle, start it; the interrupt continues with the following entries
+        while (host->hw->cmd.usr);
+        xSemaphoreTake(queue->idle_sem, 0);
+        queue->busy = true;
+        host->hw->slave.trans_done=0;
+        host->hw->slave.trans_inten=1;
+        spi_lobo_queue_start(handle, entry);
+    }
+    portEXIT_CRITICAL(&queue->mux);
+
+    return ESP_OK;
+}
+
+//--------------------------------------------------------------------
+bool IRAM_ATTR spi_lobo_queue_idle(spi_lobo_device_handle_t handle)
+{
+    return ((handle->queue == NULL) || (!handle->queue->busy));
+}
+
+//--------------------------------------------------------------------------------------------------------
+esp_err_t IRAM_ATTR spi_lobo_queue_wait_idle(spi_lobo_device_handle_t handle, TickType_t ticks_to_wait)
+{
+    if (spi_lobo_queue_idle(handle)) return ESP_OK;
+    if (!(xSemaphoreTake(handle->queue->idle_sem, ticks_to_wait))) return ESP_ERR_TIMEOUT;
+    return ESP_OK;
+}
+
 /*
 When using  'spi_lobo_transfer_data' function we can have several scenarios:
 
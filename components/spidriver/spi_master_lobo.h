@@ -128,6 +128,34 @@ struct spi_lobo_transaction_t {
 
 typedef struct spi_lobo_device_t spi_lobo_device_t;
 
+#define LB_SPI_QUEUE_DIRECT_MAX 64  // Queued transactions up to this many bytes are sent from the spi buffer, larger ones using DMA
+
+/**
+ * One entry of the device's transaction queue
+ */
+typedef struct {
+    spi_lobo_transaction_t trans;   ///< Copy of the queued transaction
+    lldesc_t *dmadesc;              ///< DMA descriptor chain built when queued, NULL if sent from the spi buffer
+} spi_lobo_queue_entry_t;
+
+/**
+ * Ring of queued transmit transactions, drained by the spi 'transaction done' interrupt
+ */
+typedef struct {
+    spi_lobo_queue_entry_t *ring;
+    lldesc_t *dmadesc;                  ///< Descriptor pool, 'desc_ct' descriptors per ring entry
+    int desc_ct;
+    int depth;
+    volatile int head;                  ///< Next entry to fill, advanced by the queueing task
+    volatile int tail;                  ///< Entry being sent, advanced by the interrupt
+    volatile bool busy;                 ///< Interrupt is draining the queue
+    SemaphoreHandle_t free_sem;         ///< Counts free ring entries
+    SemaphoreHandle_t idle_sem;         ///< Given when the queue drains
+    spi_lobo_transaction_cb_t pre_cb;   ///< Called from the interrupt before each transaction is started
+    spi_lobo_transaction_cb_t post_cb;  ///< Called from the interrupt after each transaction has completed
+    portMUX_TYPE mux;
+} spi_lobo_queue_t;
+
 typedef struct {
     spi_lobo_device_t *device[NO_DEV];
     intr_handle_t intr;
@@ -148,6 +176,7 @@ struct spi_lobo_device_t {
     spi_lobo_host_t *host;
     spi_lobo_bus_config_t bus_config;
 	spi_lobo_host_device_t host_dev;
+	spi_lobo_queue_t *queue;
 };
 
 typedef spi_lobo_device_t* spi_lobo_device_handle_t;  ///< Handle for a device on a SPI bus
@@ -273,6 +302,69 @@ bool spi_lobo_uses_native_pins(spi_lobo_device_handle_t handle);
  */
 void spi_lobo_get_native_pins(int host, int *sdi, int *sdo, int *sck);
 
+/**
+ * @brief Install an interrupt handler for the device's spi host 'transaction done' interrupt
+ * The interrupt is left disabled ('trans_inten'=0) so polled transfers are not affected,
+ * the user enables it for the transfers it wants to be notified about
+ * and must clear 'trans_done' in the handler
+ * @param handle Device handle obtained using spi_lobo_bus_add_device
+ * @param handler Interrupt handler
+ * @param arg Argument passed to the handler
+ * @return
+ *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_INVALID_STATE if the host already has an interrupt handler
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_lobo_device_intr_alloc(spi_lobo_device_handle_t handle, intr_handler_t handler, void *arg);
+
+/**
+ * @brief Create the device's transaction queue
+ * Queued transactions are transmit only and are executed back to back by the spi interrupt,
+ * the CPU is not involved between them. Descriptor chains for DMA transactions are built when queued.
+ * The host must use DMA. The queue installs the host's interrupt handler (see spi_lobo_device_intr_alloc)
+ * @param handle Device handle obtained using spi_lobo_bus_add_device
+ * @param depth Number of ring entries
+ * @param pre_cb Called from the interrupt before each transaction is started, can be NULL
+ * @param post_cb Called from the interrupt after each transaction has completed, can be NULL
+ * @return
+ *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_INVALID_STATE if the device already has a queue or the host's interrupt is used
+ *         - ESP_ERR_NO_MEM        if out of memory
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_lobo_queue_init(spi_lobo_device_handle_t handle, int depth, spi_lobo_transaction_cb_t pre_cb, spi_lobo_transaction_cb_t post_cb);
+
+/**
+ * @brief Queue a transmit transaction, it is started as soon as the previous one completes
+ * The device must be selected and stay selected until the queue is idle.
+ * The transaction is copied, the data buffer must stay valid and unchanged until it is sent.
+ * Data sent using DMA (more than LB_SPI_QUEUE_DIRECT_MAX bytes) must be DMA capable
+ * and not longer than the host's 'max_transfer_sz'
+ * @param handle Device handle obtained using spi_lobo_bus_add_device
+ * @param trans Transaction to queue, only 'length', 'tx_buffer'/'tx_data', 'flags' and 'user' are used
+ * @param ticks_to_wait Ticks to wait for a free ring entry
+ * @return
+ *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_TIMEOUT       if there was no free ring entry in time
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_lobo_queue_trans(spi_lobo_device_handle_t handle, spi_lobo_transaction_t *trans, TickType_t ticks_to_wait);
+
+/**
+ * @brief Check if all queued transactions have completed
+ */
+bool spi_lobo_queue_idle(spi_lobo_device_handle_t handle);
+
+/**
+ * @brief Wait until all queued transactions have completed
+ * @param handle Device handle obtained using spi_lobo_bus_add_device
+ * @param ticks_to_wait Ticks to wait
+ * @return
+ *         - ESP_ERR_TIMEOUT       if the queue did not drain in time
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_lobo_queue_wait_idle(spi_lobo_device_handle_t handle, TickType_t ticks_to_wait);
+
 /**
  * @brief Transimit and receive data to/from spi device based on transaction data
  * 
@@ -0,0 +1,154 @@
+/****************************************************************
+ * Includes
+ ****************************************************************/
+#include "stats.h"
+
+// cstdlib includes
+#include <stdio.h>
+#include <string.h>
+
+// FreeRTOS includes
+#include "freertos/FreeRTOS.h"
+
+// ESP-IDF includes
+#include "esp_log.h"
+
+/****************************************************************
+ * Defines, consts
+ ****************************************************************/
+#define PRINT_BUFFER_SIZE			(640)
+
+static const char * stageNames[STATS_STAGE_COUNT] =
+{
+	"recv", "reasm", "conv", "decode", "spi", "frame"
+};
+
+/****************************************************************
+ * Local variables
+ ****************************************************************/
+static stats_histogram_t histograms[STATS_STAGE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+static uint64_t statsStart = 0;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+/****************************************************************
+ * Function definitions
+ ****************************************************************/
+void Stats_Reset()
+{
+	portENTER_CRITICAL(&statsMux);
+	memset(histograms, 0, sizeof(histograms));
+	memset(counters, 0, sizeof(counters));
+	statsStart = STATS_CLOCK_US();
+	portEXIT_CRITICAL(&statsMux);
+}
+
+uint64_t Stats_Now()
+{
+	return STATS_CLOCK_US();
+}
+
+void Stats_Record(stats_stage_t stage, uint32_t duration)
+{
+	uint8_t bucket = 0;
+
+	if (stage >= STATS_STAGE_COUNT) return;
+	while (((duration >> (bucket + 1)) != 0) && (bucket < (STATS_BUCKETS - 1))) bucket++;
+
+	portENTER_CRITICAL(&statsMux);
+	stats_histogram_t * histogram = &histograms[stage];
+	histogram->count++;
+	histogram->total += duration;
+	if (duration > histogram->max) histogram->max = duration;
+	histogram->buckets[bucket]++;
+	portEXIT_CRITICAL(&statsMux);
+}
+
+void Stats_RecordSince(stats_stage_t stage, uint64_t start)
+{
+	Stats_Record(stage, (uint32_t)(STATS_CLOCK_US() - start));
+}
+
+void Stats_Add(stats_counter_t counter, uint32_t value)
+{
+	if (counter >= STATS_COUNTER_COUNT) return;
+
+	portENTER_CRITICAL(&statsMux);
+	counters[counter] += value;
+	portEXIT_CRITICAL(&statsMux);
+}
+
+void Stats_GetHistogram(stats_stage_t stage, stats_histogram_t * histogram)
+{
+	portENTER_CRITICAL(&statsMux);
+	memcpy(histogram, &histograms[stage], sizeof(stats_histogram_t));
+	portEXIT_CRITICAL(&statsMux);
+}
+
+uint64_t Stats_GetCounter(stats_counter_t counter)
+{
+	uint64_t value;
+
+	portENTER_CRITICAL(&statsMux);
+	value = counters[counter];
+	portEXIT_CRITICAL(&statsMux);
+	return value;
+}
+
+uint32_t Stats_Percentile(stats_histogram_t * histogram, uint8_t percentile)
+{
+	uint64_t target = ((uint64_t)histogram->count * percentile + 99) / 100;
+	uint64_t seen = 0;
+	uint8_t bucket;
+
+	if (histogram->count == 0) return 0;
+
+	for (bucket = 0; bucket < (STATS_BUCKETS - 1); bucket++)
+	{
+		seen += histogram->buckets[bucket];
+		if (seen >= target) break;
+	}
+	if (bucket == (STATS_BUCKETS - 1)) return histogram->max;
+	return (2u << bucket);
+}
+
+size_t Stats_Format(char * buffer, size_t bufferSize)
+{
+	stats_histogram_t histogram;
+	uint64_t elapsed = STATS_CLOCK_US() - statsStart;
+	uint64_t seconds = (elapsed / 1000000) ? (elapsed / 1000000) : 1;
+	size_t pos;
+	uint8_t stage;
+
+	pos = snprintf(buffer, bufferSize, "up=%llus frames=%llu dropped=%llu resends=%llu rx=%lluB/s spi=%lluB/s",
+			(unsigned long long)(elapsed / 1000000),
+			(unsigned long long)Stats_GetCounter(STATS_COUNTER_FRAMES),
+			(unsigned long long)Stats_GetCounter(STATS_COUNTER_DROPPED),
+			(unsigned long long)Stats_GetCounter(STATS_COUNTER_RESENDS),
+			(unsigned long long)(Stats_GetCounter(STATS_COUNTER_RX_BYTES) / seconds),
+			(unsigned long long)(Stats_GetCounter(STATS_COUNTER_SPI_BYTES) / seconds));
+
+	for (stage = 0; (stage < STATS_STAGE_COUNT) && (pos < bufferSize); stage++)
+	{
+		Stats_GetHistogram(stage, &histogram);
+		if (histogram.count == 0) continue;
+
+		pos += snprintf(&buffer[pos], bufferSize - pos, "\n%s n=%u avg=%lluus p50<%uus p99<%uus max=%uus",
+				stageNames[stage],
+				(unsigned)histogram.count,
+				(unsigned long long)(histogram.total / histogram.count),
+				(unsigned)Stats_Percentile(&histogram, 50),
+				(unsigned)Stats_Percentile(&histogram, 99),
+				(unsigned)histogram.max);
+	}
+
+	return (pos < bufferSize) ? pos : (bufferSize - 1);
+}
+
+void Stats_Print()
+{
+	char buffer[PRINT_BUFFER_SIZE];
+
+	Stats_Format(buffer, sizeof(buffer));
+	ESP_LOGI("Stats", "\n%s", buffer);
+}
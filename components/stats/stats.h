@@ -0,0 +1,85 @@
+#ifndef STATS_STATS_H_
+#define STATS_STATS_H_
+
+/****************************************************************
+ * Includes
+ ****************************************************************/
+// cstdlib includes
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/****************************************************************
+ * Defines, consts
+ ****************************************************************/
+// Monotonic microsecond clock; define STATS_CLOCK_US before including
+// this header to build against another clock (e.g. clock_gettime on a host)
+#ifndef STATS_CLOCK_US
+#include "esp_timer.h"
+#define STATS_CLOCK_US()			((uint64_t)esp_timer_get_time())
+#endif
+
+// Histogram bucket n counts durations of [2^n, 2^(n+1)) us, the last one everything longer
+#define STATS_BUCKETS				(21)
+
+/****************************************************************
+ * Typedefs, structs, enums
+ ****************************************************************/
+typedef enum
+{
+	STATS_STAGE_RECEIVE,		// request sent until the whole response is in
+	STATS_STAGE_REASSEMBLY,		// moving out of place chunks within a response
+	STATS_STAGE_CONVERT,		// color conversion to the display's pixel format
+	STATS_STAGE_DECODE,			// decoding compressed frame data
+	STATS_STAGE_SPI,			// first pixel queued until the frame is on the display
+	STATS_STAGE_FRAME,			// request sent until the frame is on the display
+	STATS_STAGE_COUNT
+} stats_stage_t;
+
+typedef enum
+{
+	STATS_COUNTER_FRAMES,		// frames drawn
+	STATS_COUNTER_DROPPED,		// frames failed to receive
+	STATS_COUNTER_RESENDS,		// resend requests sent
+	STATS_COUNTER_RX_BYTES,		// response bytes received
+	STATS_COUNTER_SPI_BYTES,	// pixel bytes sent to the display
+	STATS_COUNTER_COUNT
+} stats_counter_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint64_t total;
+	uint32_t max;
+	uint32_t buckets[STATS_BUCKETS];
+} stats_histogram_t;
+
+/****************************************************************
+ * Function declarations
+ ****************************************************************/
+void Stats_Reset();
+
+uint64_t Stats_Now();
+
+// Record a duration in microseconds for a stage
+void Stats_Record(stats_stage_t stage, uint32_t duration);
+
+// Record the time since 'start' (a Stats_Now() value) for a stage
+void Stats_RecordSince(stats_stage_t stage, uint64_t start);
+
+void Stats_Add(stats_counter_t counter, uint32_t value);
+
+// Copy of a stage's histogram
+void Stats_GetHistogram(stats_stage_t stage, stats_histogram_t * histogram);
+
+uint64_t Stats_GetCounter(stats_counter_t counter);
+
+// Upper bound of the bucket holding the given percentile (0-100), in microseconds
+uint32_t Stats_Percentile(stats_histogram_t * histogram, uint8_t percentile);
+
+// Write a text summary, returns its length
+size_t Stats_Format(char * buffer, size_t bufferSize);
+
+void Stats_Print();
+
+#endif /* STATS_STATS_H_ */
@@ -17,7 +17,9 @@
 #include <math.h>
 #include "esp32/rom/tjpgd.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "tftspi.h"
+#include "tfttrig.h"
 
 
 #define DEG_TO_RAD 0.01745329252
@@ -75,6 +77,7 @@ uint8_t	text_wrap = 0;			// character wrapping to new line
 color_t	_fg = {  0, 255,   0};
 color_t _bg = {  0,   0,   0};
 uint8_t image_debug = 0;
+uint8_t fill_box = 0;			// fill the rest of filled shape's bounding box with _bg
 
 float _angleOffset = DEFAULT_ANGLE_OFFSET;
 
@@ -120,6 +123,51 @@ static dispWin_t dispWinTemp;
 static uint8_t *userfont = NULL;
 static int TFT_OFFSET = 0;
 static propFont	fontChar;
+// Offset of each character's glyph header in the current proportional font, 0 if not in the font
+static uint16_t glyphIndex[256];
+
+// Spans of the filled shape being drawn, one per bounding box row
+// Only used for convex shapes, every row's spans then join into a single span
+#define SPAN_MAX_ROWS	480
+// Spans sent to the display in one session, see drawSpans()
+#define SPAN_BATCH		128
+// Runs of at least this many identical rows are sent as one filled rectangle
+#define SPAN_RECT_ROWS	8
+static uint8_t spanActive = 0;
+static int spanX1, spanY1, spanX2, spanY2;
+static int16_t spanMin[SPAN_MAX_ROWS];
+static int16_t spanMax[SPAN_MAX_ROWS];
+static uint8_t spanColor[TFT_PIXEL_BYTES];
+static uint8_t spanBg[TFT_PIXEL_BYTES];
+
+// Pixels waiting to be drawn, one batch per color
+#define PIXEL_BATCH_SIZE	256
+#define PIXEL_BATCH_COLORS	2
+typedef struct {
+	color_t color;
+	int count;
+	tft_point_t points[PIXEL_BATCH_SIZE];
+} pixel_batch_t;
+static pixel_batch_t pixBatch[PIXEL_BATCH_COLORS];
+static uint8_t pixBatchActive = 0;
+
+#if GLYPH_CACHE_ENTRIES
+typedef struct {
+	const uint8_t *font;
+	uint8_t code;
+	uint8_t fixed;							// font_forceFixed was set
+	uint8_t fg[TFT_PIXEL_BYTES];			// colors in display's pixel format
+	uint8_t bg[TFT_PIXEL_BYTES];
+	uint16_t width;
+	uint16_t height;
+	uint32_t used;							// last use, 0 if the entry is free
+	uint8_t *pixels;						// width*height pixels in display's pixel format
+} glyph_cache_entry_t;
+
+static glyph_cache_entry_t glyphCache[GLYPH_CACHE_ENTRIES];
+static uint32_t glyphCacheUse = 0;
+#endif
+static glyph_cache_stats_t glyphCacheStats;
 static float _arcAngleMax = DEFAULT_ARC_ANGLE_MAX;
 
 
@@ -142,12 +190,70 @@ int TFT_compare_colors(color_t c1, color_t c2)
 	return 0;
 }
 
+// ==== Pixel batches ==============================================
+// Between _pixBatchBegin() and _pixBatchEnd() pixels are collected per color
+// and sent with drawPixels(), which merges them into runs in one session
+
+//----------------------------------------------
+static void _pixBatchFlush(pixel_batch_t *batch) {
+	if (batch->count == 0) return;
+	drawPixels(batch->points, batch->count, batch->color);
+	batch->count = 0;
+}
+
+//-------------------------------
+static void _pixBatchBegin() {
+	pixBatchActive++;
+}
+
+//-----------------------------
+static void _pixBatchEnd() {
+	if (pixBatchActive == 0) return;
+	if (--pixBatchActive) return;
+	for (int n=0; n<PIXEL_BATCH_COLORS; n++) _pixBatchFlush(&pixBatch[n]);
+}
+
+//------------------------------------------------------------
+static void _pixBatchAdd(int16_t x, int16_t y, color_t color) {
+	pixel_batch_t *batch = NULL;
+
+	for (int n=0; n<PIXEL_BATCH_COLORS; n++) {
+		if ((pixBatch[n].count) && (memcmp(&pixBatch[n].color, &color, sizeof(color_t)) == 0)) {
+			batch = &pixBatch[n];
+			break;
+		}
+	}
+	if (batch == NULL) {
+		// use an empty batch, or send the fullest one to make room
+		for (int n=0; n<PIXEL_BATCH_COLORS; n++) {
+			if (pixBatch[n].count == 0) {
+				batch = &pixBatch[n];
+				break;
+			}
+		}
+		if (batch == NULL) {
+			batch = &pixBatch[0];
+			for (int n=1; n<PIXEL_BATCH_COLORS; n++) {
+				if (pixBatch[n].count > batch->count) batch = &pixBatch[n];
+			}
+			_pixBatchFlush(batch);
+		}
+		batch->color = color;
+	}
+	else if (batch->count == PIXEL_BATCH_SIZE) _pixBatchFlush(batch);
+
+	batch->points[batch->count].x = x;
+	batch->points[batch->count].y = y;
+	batch->count++;
+}
+
 // draw color pixel on screen
 //------------------------------------------------------------------------
 static void _drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel) {
 
 	if ((x < dispWin.x1) || (y < dispWin.y1) || (x > dispWin.x2) || (y > dispWin.y2)) return;
-	drawPixel(x, y, color, sel);
+	if (pixBatchActive) _pixBatchAdd(x, y, color);
+	else drawPixel(x, y, color, sel);
 }
 
 //====================================================================
@@ -156,6 +262,14 @@ void TFT_drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel) {
 	_drawPixel(x+dispWin.x1, y+dispWin.y1, color, sel);
 }
 
+//=================================================================
+void TFT_drawPixels(tft_point_t *points, int count, color_t color) {
+
+	_pixBatchBegin();
+	for (int n=0; n<count; n++) _drawPixel(points[n].x+dispWin.x1, points[n].y+dispWin.y1, color, 0);
+	_pixBatchEnd();
+}
+
 //===========================================
 color_t TFT_readPixel(int16_t x, int16_t y) {
 
@@ -207,6 +321,177 @@ static void _drawFastHLineBuffer(int16_t x, int16_t y, int16_t w, color_t * colo
 	TFT_pushColorRepBuffer(x, y, x+w-1, y, color, (uint32_t)w);
 }
 
+// push a w*h block of colors from buffer, clipped to the display window
+//------------------------------------------------------------------------------------------
+static void _blitRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t *buf, uint8_t raw) {
+	// raw buffers hold pixels in display format, otherwise color_t values
+	int pxsize = (raw) ? TFT_PIXEL_BYTES : sizeof(color_t);
+	int16_t stride = w;
+
+	// clipping
+	if ((w <= 0) || (h <= 0)) return;
+	if ((x > dispWin.x2) || (y > dispWin.y2)) return;
+	if (((x + w - 1) < dispWin.x1) || ((y + h - 1) < dispWin.y1)) return;
+	if (y < dispWin.y1) {
+		buf += (dispWin.y1 - y) * stride * pxsize;
+		h -= (dispWin.y1 - y);
+		y = dispWin.y1;
+	}
+	if (x < dispWin.x1) {
+		buf += (dispWin.x1 - x) * pxsize;
+		w -= (dispWin.x1 - x);
+		x = dispWin.x1;
+	}
+	if ((x + w) > (dispWin.x2+1)) w = dispWin.x2 - x + 1;
+	if ((y + h) > (dispWin.y2+1)) h = dispWin.y2 - y + 1;
+
+	if (w == stride) {
+		// rows are contiguous, send the whole block in one transaction
+		if (raw) TFT_pushRawBuffer(x, y, x+w-1, y+h-1, buf, (uint32_t)(w*h*pxsize));
+		else TFT_pushColorRepBuffer(x, y, x+w-1, y+h-1, (color_t *)buf, (uint32_t)(w*h));
+		return;
+	}
+
+	// clipped horizontally, send row by row
+	if (disp_select() != ESP_OK) return;
+	for (int16_t i=0; i<h; i++) {
+		wait_trans_finish(0);
+		if (raw) send_raw_data(x, y+i, x+w-1, y+i, (uint32_t)(w*pxsize), buf + (i * stride * pxsize));
+		else send_data(x, y+i, x+w-1, y+i, (uint32_t)w, (color_t *)(buf + (i * stride * pxsize)));
+	}
+	disp_deselect();
+}
+
+// ==== Span rasterizer ============================================
+
+// Start collecting the spans of a filled shape within the given bounding box
+// Returns 0 if the box is outside of the display window
+//------------------------------------------------------------
+static int _spanBegin(int x1, int y1, int x2, int y2) {
+	if (x1 < dispWin.x1) x1 = dispWin.x1;
+	if (y1 < dispWin.y1) y1 = dispWin.y1;
+	if (x2 > dispWin.x2) x2 = dispWin.x2;
+	if (y2 > dispWin.y2) y2 = dispWin.y2;
+	if ((x1 > x2) || (y1 > y2) || ((y2 - y1) >= SPAN_MAX_ROWS)) return 0;
+
+	spanX1 = x1;
+	spanY1 = y1;
+	spanX2 = x2;
+	spanY2 = y2;
+	for (int r=0; r<=(y2-y1); r++) {
+		spanMin[r] = INT16_MAX;
+		spanMax[r] = INT16_MIN;
+	}
+	spanActive = 1;
+	return 1;
+}
+
+// Add the span (x,y),(x+w-1,y)
+//-----------------------------------------
+static void _spanAdd(int x, int y, int w) {
+	int x2 = x + w - 1;
+
+	if ((y < spanY1) || (y > spanY2) || (w <= 0)) return;
+	if (x < spanX1) x = spanX1;
+	if (x2 > spanX2) x2 = spanX2;
+	if (x > x2) return;
+	if (x < spanMin[y - spanY1]) spanMin[y - spanY1] = x;
+	if (x2 > spanMax[y - spanY1]) spanMax[y - spanY1] = x2;
+}
+
+// Draw horizontal line as part of the shape being collected, or directly
+//-----------------------------------------------------------------
+static void _fillSpanH(int16_t x, int16_t y, int16_t w, color_t color) {
+	if (spanActive) _spanAdd(x, y, w);
+	else _drawFastHLine(x, y, w, color);
+}
+
+// Draw vertical line as part of the shape being collected, or directly
+//-----------------------------------------------------------------
+static void _fillSpanV(int16_t x, int16_t y, int16_t h, color_t color) {
+	if (spanActive) {
+		for (int n=0; n<h; n++) _spanAdd(x, y+n, 1);
+	}
+	else _drawFastVLine(x, y, h, color);
+}
+
+// Fill 'n' pixels at 'dst' with the pixel 'pix'
+//------------------------------------------------------------------
+static void _fillNative(uint8_t *dst, const uint8_t *pix, int n) {
+	int done = TFT_PIXEL_BYTES;
+	int total = n * TFT_PIXEL_BYTES;
+	int count;
+
+	if (n <= 0) return;
+	memcpy(dst, pix, TFT_PIXEL_BYTES);
+	while (done < total) {
+		count = ((done < (total - done)) ? done : (total - done));
+		memcpy(dst + done, dst, count);
+		done += count;
+	}
+}
+
+// Generate bounding box rows: background with the shape's span
+//----------------------------------------------------------------------
+static void _spanRows(uint8_t *buf, int y, int rows, void *arg) {
+	int w = spanX2 - spanX1 + 1;
+	int r;
+
+	for (int n=0; n<rows; n++) {
+		r = y - spanY1 + n;
+		_fillNative(buf, spanBg, w);
+		if (spanMin[r] <= spanMax[r]) {
+			_fillNative(buf + ((spanMin[r] - spanX1) * TFT_PIXEL_BYTES), spanColor, spanMax[r] - spanMin[r] + 1);
+		}
+		buf += w * TFT_PIXEL_BYTES;
+	}
+}
+
+// Draw the collected spans
+// With 'fill_box' set the whole bounding box is sent in one transfer, otherwise
+// the spans are sent in one display session, tall runs of identical rows as rectangles
+//------------------------------------------
+static void _spanEnd(color_t color) {
+	tft_span_t spans[SPAN_BATCH];
+	int nspans = 0;
+	int r, r2;
+
+	spanActive = 0;
+
+	if (fill_box) {
+		native_color(color, spanColor);
+		native_color(_bg, spanBg);
+		TFT_pushRows(spanX1, spanY1, spanX2, spanY2, _spanRows, NULL);
+		return;
+	}
+
+	r = 0;
+	while (r <= (spanY2 - spanY1)) {
+		if (spanMin[r] > spanMax[r]) {
+			r++;
+			continue;
+		}
+		r2 = r;
+		while ((r2 < (spanY2 - spanY1)) && (spanMin[r2+1] == spanMin[r]) && (spanMax[r2+1] == spanMax[r])) r2++;
+		if ((r2 - r + 1) >= SPAN_RECT_ROWS) {
+			TFT_pushColorRep(spanMin[r], spanY1 + r, spanMax[r], spanY1 + r2, color,
+					(uint32_t)((spanMax[r] - spanMin[r] + 1) * (r2 - r + 1)));
+			r = r2 + 1;
+			continue;
+		}
+		for (; r <= r2; r++) {
+			spans[nspans].x = spanMin[r];
+			spans[nspans].y = spanY1 + r;
+			spans[nspans].w = spanMax[r] - spanMin[r] + 1;
+			if (++nspans == SPAN_BATCH) {
+				drawSpans(spans, nspans, color);
+				nspans = 0;
+			}
+		}
+	}
+	drawSpans(spans, nspans, color);
+}
+
 //======================================================================
 void TFT_drawFastVLine(int16_t x, int16_t y, int16_t h, color_t color) {
 	_drawFastVLine(x+dispWin.x1, y+dispWin.y1, h, color);
@@ -221,6 +506,53 @@ void TFT_drawFastHLineBuffer(int16_t x, int16_t y, int16_t w, color_t * color) {
 	_drawFastHLineBuffer(x+dispWin.x1, y+dispWin.y1, w, color);
 }
 
+//==========================================================================
+void TFT_blitRect(int16_t x, int16_t y, int16_t w, int16_t h, color_t *buf) {
+	_blitRect(x+dispWin.x1, y+dispWin.y1, w, h, (uint8_t *)buf, 0);
+}
+
+//=========================================================================
+void TFT_blitRaw(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t *buf) {
+	_blitRect(x+dispWin.x1, y+dispWin.y1, w, h, buf, 1);
+}
+
+//=====================================================================================================================
+tft_async_t TFT_submitRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t *buf, tft_async_cb_t cb, void *arg) {
+	x += dispWin.x1;
+	y += dispWin.y1;
+	if ((w <= 0) || (h <= 0)) return 0;
+
+	if ((x < dispWin.x1) || (y < dispWin.y1) || ((x + w - 1) > dispWin.x2) || ((y + h - 1) > dispWin.y2)) {
+		// clipped rows are not contiguous, push it synchronously
+		_blitRect(x, y, w, h, buf, 1);
+		if (cb) cb(0, arg);
+		return 0;
+	}
+	return send_raw_async(x, y, x+w-1, y+h-1, (uint32_t)(w*h*TFT_PIXEL_BYTES), buf, cb, arg);
+}
+
+//==========================================================
+esp_err_t TFT_waitAsync(tft_async_t handle, TickType_t timeout) {
+	if (handle == 0) return ESP_OK;
+	return wait_async(handle, timeout);
+}
+
+// deselecting waits for the transfer in flight
+//=============================
+esp_err_t TFT_flushAsync() {
+	return disp_deselect();
+}
+
+//======================================
+esp_err_t TFT_setShadow(uint8_t enable) {
+	return shadow_enable(enable);
+}
+
+//===============
+void TFT_flush() {
+	shadow_flush();
+}
+
 // Bresenham's algorithm - thx wikipedia - speed enhanced by Bodmer this uses
 // the eficient FastH/V Line draw routine for segments of 2 pixels or more
 //----------------------------------------------------------------------------------
@@ -286,7 +618,19 @@ static void _drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, color_t co
 //==============================================================================
 void TFT_drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, color_t color)
 {
+	_pixBatchBegin();
 	_drawLine(x0+dispWin.x1, y0+dispWin.y1, x1+dispWin.x1, y1+dispWin.y1, color);
+	_pixBatchEnd();
+}
+
+//===================================================================
+void TFT_drawPolyline(tft_point_t *points, int count, color_t color)
+{
+	_pixBatchBegin();
+	for (int n=1; n<count; n++) {
+		_drawLine(points[n-1].x+dispWin.x1, points[n-1].y+dispWin.y1, points[n].x+dispWin.x1, points[n].y+dispWin.y1, color);
+	}
+	_pixBatchEnd();
 }
 
 // fill a rectangle
@@ -356,7 +700,7 @@ static void drawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornerna
 	int16_t x = 0;
 	int16_t y = r;
 
-	disp_select();
+	_pixBatchBegin();
 	while (x < y) {
 		if (f >= 0) {
 			y--;
@@ -383,7 +727,7 @@ static void drawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornerna
 			_drawPixel(x0 - x, y0 - y, color, 0);
 		}
 	}
-	disp_deselect();
+	_pixBatchEnd();
 }
 
 // Used to do circles and roundrects
@@ -399,8 +743,8 @@ static void fillCircleHelper(int16_t x0, int16_t y0, int16_t r,	uint8_t cornerna
 
 	while (x < y) {
 		if (f >= 0) {
-			if (cornername & 0x1) _drawFastVLine(x0 + y, y0 - x, 2 * x + 1 + delta, color);
-			if (cornername & 0x2) _drawFastVLine(x0 - y, y0 - x, 2 * x + 1 + delta, color);
+			if (cornername & 0x1) _fillSpanV(x0 + y, y0 - x, 2 * x + 1 + delta, color);
+			if (cornername & 0x2) _fillSpanV(x0 - y, y0 - x, 2 * x + 1 + delta, color);
 			ylm = x0 - y;
 			y--;
 			ddF_y += 2;
@@ -411,8 +755,8 @@ static void fillCircleHelper(int16_t x0, int16_t y0, int16_t r,	uint8_t cornerna
 		f += ddF_x;
 
 		if ((x0 - x) > ylm) {
-			if (cornername & 0x1) _drawFastVLine(x0 + x, y0 - y, 2 * y + 1 + delta, color);
-			if (cornername & 0x2) _drawFastVLine(x0 - x, y0 - y, 2 * y + 1 + delta, color);
+			if (cornername & 0x1) _fillSpanV(x0 + x, y0 - y, 2 * y + 1 + delta, color);
+			if (cornername & 0x2) _fillSpanV(x0 - x, y0 - y, 2 * y + 1 + delta, color);
 		}
 	}
 }
@@ -444,12 +788,16 @@ void TFT_fillRoundRect(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t r,
 	x += dispWin.x1;
 	y += dispWin.y1;
 
+	if (!_spanBegin(x, y, x + w - 1, y + h - 1)) return;
+
 	// smarter version
-	_fillRect(x + r, y, w - 2 * r, h, color);
+	for (int n=0; n<h; n++) _spanAdd(x + r, y + n, w - 2 * r);
 
 	// draw four corners
 	fillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
 	fillCircleHelper(x + r, y + r, r, 2, h - 2 * r - 1, color);
+
+	_spanEnd(color);
 }
 
 
@@ -458,21 +806,27 @@ void TFT_fillRoundRect(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t r,
 //-----------------------------------------------------------------------------------------------
 static void _drawLineByAngle(int16_t x, int16_t y, int16_t angle, uint16_t length, color_t color)
 {
+	int32_t a = TRIG_DEG(angle + _angleOffset);
+
 	_drawLine(
 		x,
 		y,
-		x + length * cos((angle + _angleOffset) * DEG_TO_RAD),
-		y + length * sin((angle + _angleOffset) * DEG_TO_RAD), color);
+		x + TRIG_MUL(length, trig_cos(a)),
+		y + TRIG_MUL(length, trig_sin(a)), color);
 }
 
 //---------------------------------------------------------------------------------------------------------------
 static void _DrawLineByAngle(int16_t x, int16_t y, int16_t angle, uint16_t start, uint16_t length, color_t color)
 {
+	int32_t a = TRIG_DEG(angle + _angleOffset);
+	int16_t c = trig_cos(a);
+	int16_t s = trig_sin(a);
+
 	_drawLine(
-		x + start * cos((angle + _angleOffset) * DEG_TO_RAD),
-		y + start * sin((angle + _angleOffset) * DEG_TO_RAD),
-		x + (start + length) * cos((angle + _angleOffset) * DEG_TO_RAD),
-		y + (start + length) * sin((angle + _angleOffset) * DEG_TO_RAD), color);
+		x + TRIG_MUL(start, c),
+		y + TRIG_MUL(start, s),
+		x + TRIG_MUL(start + length, c),
+		y + TRIG_MUL(start + length, s), color);
 }
 
 //===========================================================================================================
@@ -533,7 +887,7 @@ static void _fillTriangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, ui
     else if(x1 > b) b = x1;
     if(x2 < a)      a = x2;
     else if(x2 > b) b = x2;
-    _drawFastHLine(a, y0, b-a+1, color);
+    _fillSpanH(a, y0, b-a+1, color);
     return;
   }
 
@@ -567,7 +921,7 @@ static void _fillTriangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, ui
     b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
     */
     if(a > b) swap(a,b);
-    _drawFastHLine(a, y, b-a+1, color);
+    _fillSpanH(a, y, b-a+1, color);
   }
 
   // For lower part of triangle, find scanline crossings for segments
@@ -584,18 +938,23 @@ static void _fillTriangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, ui
     b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
     */
     if(a > b) swap(a,b);
-    _drawFastHLine(a, y, b-a+1, color);
+    _fillSpanH(a, y, b-a+1, color);
   }
 }
 
 //================================================================================================================
 void TFT_fillTriangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, color_t color)
 {
-	_fillTriangle(
-			x0 + dispWin.x1, y0 + dispWin.y1,
-			x1 + dispWin.x1, y1 + dispWin.y1,
-			x2 + dispWin.x1, y2 + dispWin.y1,
-			color);
+	x0 += dispWin.x1;
+	y0 += dispWin.y1;
+	x1 += dispWin.x1;
+	y1 += dispWin.y1;
+	x2 += dispWin.x1;
+	y2 += dispWin.y1;
+
+	if (!_spanBegin(min(x0, min(x1, x2)), min(y0, min(y1, y2)), max(x0, max(x1, x2)), max(y0, max(y1, y2)))) return;
+	_fillTriangle(x0, y0, x1, y1, x2, y2, color);
+	_spanEnd(color);
 }
 
 //====================================================================
@@ -608,7 +967,7 @@ void TFT_drawCircle(int16_t x, int16_t y, int radius, color_t color) {
 	int x1 = 0;
 	int y1 = radius;
 
-	disp_select();
+	_pixBatchBegin();
 	_drawPixel(x, y + radius, color, 0);
 	_drawPixel(x, y - radius, color, 0);
 	_drawPixel(x + radius, y, color, 0);
@@ -631,7 +990,7 @@ void TFT_drawCircle(int16_t x, int16_t y, int radius, color_t color) {
 		_drawPixel(x + y1, y - x1, color, 0);
 		_drawPixel(x - y1, y - x1, color, 0);
 	}
-  disp_deselect();
+  _pixBatchEnd();
 }
 
 //====================================================================
@@ -639,14 +998,15 @@ void TFT_fillCircle(int16_t x, int16_t y, int radius, color_t color) {
 	x += dispWin.x1;
 	y += dispWin.y1;
 
-	_drawFastVLine(x, y-radius, 2*radius+1, color);
+	if (!_spanBegin(x-radius, y-radius, x+radius, y+radius)) return;
+	_fillSpanV(x, y-radius, 2*radius+1, color);
 	fillCircleHelper(x, y, radius, 3, 0, color);
+	_spanEnd(color);
 }
 
 //----------------------------------------------------------------------------------------------------------------
 static void _draw_ellipse_section(uint16_t x, uint16_t y, uint16_t x0, uint16_t y0, color_t color, uint8_t option)
 {
-	disp_select();
     // upper right
     if ( option & TFT_ELLIPSE_UPPER_RIGHT ) _drawPixel(x0 + x, y0 - y, color, 0);
     // upper left
@@ -655,7 +1015,6 @@ static void _draw_ellipse_section(uint16_t x, uint16_t y, uint16_t x0, uint16_t
     if ( option & TFT_ELLIPSE_LOWER_RIGHT ) _drawPixel(x0 + x, y0 + y, color, 0);
     // lower left
     if ( option & TFT_ELLIPSE_LOWER_LEFT ) _drawPixel(x0 - x, y0 + y, color, 0);
-	disp_deselect();
 }
 
 //=====================================================================================================
@@ -697,6 +1056,7 @@ void TFT_drawEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 	stopx *= rx;
 	stopy = 0;
 
+	_pixBatchBegin();
 	while( stopx >= stopy ) {
 		_draw_ellipse_section(x, y, x0, y0, color, option);
 		y++;
@@ -743,19 +1103,20 @@ void TFT_drawEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 			ychg += rxrx2;
 		}
 	}
+	_pixBatchEnd();
 }
 
 //-----------------------------------------------------------------------------------------------------------------------
 static void _draw_filled_ellipse_section(uint16_t x, uint16_t y, uint16_t x0, uint16_t y0, color_t color, uint8_t option)
 {
     // upper right
-    if ( option & TFT_ELLIPSE_UPPER_RIGHT ) _drawFastVLine(x0+x, y0-y, y+1, color);
+    if ( option & TFT_ELLIPSE_UPPER_RIGHT ) _fillSpanV(x0+x, y0-y, y+1, color);
     // upper left
-    if ( option & TFT_ELLIPSE_UPPER_LEFT ) _drawFastVLine(x0-x, y0-y, y+1, color);
+    if ( option & TFT_ELLIPSE_UPPER_LEFT ) _fillSpanV(x0-x, y0-y, y+1, color);
     // lower right
-    if ( option & TFT_ELLIPSE_LOWER_RIGHT ) _drawFastVLine(x0+x, y0, y+1, color);
+    if ( option & TFT_ELLIPSE_LOWER_RIGHT ) _fillSpanV(x0+x, y0, y+1, color);
     // lower left
-    if ( option & TFT_ELLIPSE_LOWER_LEFT ) _drawFastVLine(x0-x, y0, y+1, color);
+    if ( option & TFT_ELLIPSE_LOWER_LEFT ) _fillSpanV(x0-x, y0, y+1, color);
 }
 
 //=====================================================================================================
@@ -797,6 +1158,12 @@ void TFT_fillEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 	stopx *= rx;
 	stopy = 0;
 
+	// bounding box of the selected quarters
+	if (!_spanBegin((option & (TFT_ELLIPSE_UPPER_LEFT | TFT_ELLIPSE_LOWER_LEFT)) ? x0 - rx : x0,
+			(option & (TFT_ELLIPSE_UPPER_LEFT | TFT_ELLIPSE_UPPER_RIGHT)) ? y0 - ry : y0,
+			(option & (TFT_ELLIPSE_UPPER_RIGHT | TFT_ELLIPSE_LOWER_RIGHT)) ? x0 + rx : x0,
+			(option & (TFT_ELLIPSE_LOWER_LEFT | TFT_ELLIPSE_LOWER_RIGHT)) ? y0 + ry : y0)) return;
+
 	while( stopx >= stopy ) {
 		_draw_filled_ellipse_section(x, y, x0, y0, color, option);
 		y++;
@@ -843,53 +1210,178 @@ void TFT_fillEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 			ychg += rxrx2;
 		}
 	}
+	_spanEnd(color);
 }
 
 
 // ==== ARC DRAWING ===================================================================
 
-//---------------------------------------------------------------------------------------------------------------------------------
-static void _fillArcOffsetted(uint16_t cx, uint16_t cy, uint16_t radius, uint16_t thickness, float start, float end, color_t color)
+// Arc sectors are drawn row by row: the ring gives up to two spans on a row,
+// each sector edge is a half plane through the center which cuts a row at one x,
+// so all span ends are computed directly instead of testing every pixel
+#define ARC_FULL_SPAN	0x7FFF
+
+//---------------------------------------
+static uint32_t _isqrt(uint32_t v)
 {
-	//float sslope = (float)cos_lookup(start) / (float)sin_lookup(start);
-	//float eslope = (float)cos_lookup(end) / (float)sin_lookup(end);
-	float sslope = (cos(start/_arcAngleMax * 2 * PI) * _arcAngleMax) / (sin(start/_arcAngleMax * 2 * PI) * _arcAngleMax) ;
-	float eslope = (cos(end/_arcAngleMax * 2 * PI) * _arcAngleMax) / (sin(end/_arcAngleMax * 2 * PI) * _arcAngleMax);
+	uint32_t res = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > v) bit >>= 2;
+	while (bit) {
+		if (v >= res + bit) {
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else res >>= 1;
+		bit >>= 2;
+	}
+	return res;
+}
 
-	if (end == 360) eslope = -1000000;
+// floor(n / d), d > 0
+//-------------------------------------------------
+static int32_t _floorDiv(int64_t n, int64_t d)
+{
+	if (n >= 0) return n / d;
+	return -((-n + d - 1) / d);
+}
 
+// Span of row 'y' for which a*x + b*y >= t, returned in *lo, *hi
+//-------------------------------------------------------------------------------
+static void _arcHalfPlane(int32_t a, int32_t b, int32_t t, int y, int *lo, int *hi)
+{
+	int64_t n = (int64_t)t - (int64_t)b * y;
+
+	*lo = -ARC_FULL_SPAN;
+	*hi = ARC_FULL_SPAN;
+	if (a > 0) *lo = -_floorDiv(-n, a);		// x >= ceil(n/a)
+	else if (a < 0) *hi = _floorDiv(-n, -a);	// x <= floor(n/a)
+	else if (n > 0) {							// no x
+		*lo = ARC_FULL_SPAN;
+		*hi = -ARC_FULL_SPAN;
+	}
+}
+
+// Fill the ring sector of 'thickness' inside 'radius' from angle 'start' clockwise by 'sweep' degrees
+// The end edge is not included, so adjacent sectors never share pixels
+//-------------------------------------------------------------------------------------------------------
+static void _fillArcSector(int cx, int cy, int radius, int thickness, float start, float sweep, color_t color)
+{
 	int ir2 = (radius - thickness) * (radius - thickness);
 	int or2 = radius * radius;
+	int y1 = -radius + 1, y2 = radius - 1;
+	int full = (sweep >= 360);
+	int sx, sy, ex, ey;
+	int xo, xi, v;
+	int ring[2][2], sect[2][2];
+	int nring, nsect, lo, hi;
+	tft_span_t spans[SPAN_BATCH];
+	int nspans = 0;
+
+	if ((sweep <= 0) || (radius <= 0)) return;
+
+	// sector edges as Q15 unit vectors
+	sx = trig_cos(TRIG_DEG(start));
+	sy = trig_sin(TRIG_DEG(start));
+	ex = trig_cos(TRIG_DEG(start + sweep));
+	ey = trig_sin(TRIG_DEG(start + sweep));
+
+	if ((cy + y1) < dispWin.y1) y1 = dispWin.y1 - cy;
+	if ((cy + y2) > dispWin.y2) y2 = dispWin.y2 - cy;
+
+	for (int y = y1; y <= y2; y++) {
+		// ring spans, x*x + y*y < or2 && x*x + y*y >= ir2
+		xo = _isqrt(or2 - y*y - 1);
+		v = ir2 - y*y;
+		if (v <= 0) xi = 0;
+		else {
+			xi = _isqrt(v);
+			if ((xi * xi) < v) xi++;
+		}
+		if (xi > xo) continue;
+		if (xi == 0) {
+			ring[0][0] = -xo; ring[0][1] = xo;
+			nring = 1;
+		}
+		else {
+			ring[0][0] = -xo; ring[0][1] = -xi;
+			ring[1][0] = xi; ring[1][1] = xo;
+			nring = 2;
+		}
 
-	disp_select();
-	for (int x = -radius; x <= radius; x++) {
-		for (int y = -radius; y <= radius; y++) {
-			int x2 = x * x;
-			int y2 = y * y;
-
-			if (
-				(x2 + y2 < or2 && x2 + y2 >= ir2) &&
-				(
-				(y > 0 && start < 180 && x <= y * sslope) ||
-				(y < 0 && start > 180 && x >= y * sslope) ||
-				(y < 0 && start <= 180) ||
-				(y == 0 && start <= 180 && x < 0) ||
-				(y == 0 && start == 0 && x > 0)
-				) &&
-				(
-				(y > 0 && end < 180 && x >= y * eslope) ||
-				(y < 0 && end > 180 && x <= y * eslope) ||
-				(y > 0 && end >= 180) ||
-				(y == 0 && end >= 180 && x < 0) ||
-				(y == 0 && start == 0 && x > 0)
-				)
-				)
-				_drawPixel(cx+x, cy+y, color, 0);
+		// sector spans, on or after the start edge and before the end edge
+		if (full) {
+			sect[0][0] = -ARC_FULL_SPAN; sect[0][1] = ARC_FULL_SPAN;
+			nsect = 1;
+		}
+		else {
+			_arcHalfPlane(-sy, sx, 0, y, &sect[0][0], &sect[0][1]);
+			_arcHalfPlane(ey, -ex, 1, y, &sect[1][0], &sect[1][1]);
+			if (sweep <= 180) {
+				// both half planes
+				sect[0][0] = max(sect[0][0], sect[1][0]);
+				sect[0][1] = min(sect[0][1], sect[1][1]);
+				nsect = 1;
+			}
+			else {
+				// either of the half planes
+				if (sect[1][0] < sect[0][0]) {
+					lo = sect[0][0]; hi = sect[0][1];
+					sect[0][0] = sect[1][0]; sect[0][1] = sect[1][1];
+					sect[1][0] = lo; sect[1][1] = hi;
+				}
+				nsect = 2;
+				if (sect[1][0] <= (sect[0][1] + 1)) {
+					sect[0][1] = max(sect[0][1], sect[1][1]);
+					nsect = 1;
+				}
+			}
+		}
+
+		for (int r = 0; r < nring; r++) {
+			for (int s = 0; s < nsect; s++) {
+				lo = max(ring[r][0], sect[s][0]);
+				hi = min(ring[r][1], sect[s][1]);
+				// clip to the display window
+				lo = max(cx + lo, dispWin.x1);
+				hi = min(cx + hi, dispWin.x2);
+				if (lo > hi) continue;
+				spans[nspans].x = lo;
+				spans[nspans].y = cy + y;
+				spans[nspans].w = hi - lo + 1;
+				if (++nspans == SPAN_BATCH) {
+					drawSpans(spans, nspans, color);
+					nspans = 0;
+				}
+			}
 		}
 	}
-	disp_deselect();
+	drawSpans(spans, nspans, color);
 }
 
+// Convert arc position to degrees on screen, including the angle offset
+//------------------------------------------
+static float _arcDegrees(float angle)
+{
+	float deg = fmodf(angle, _arcAngleMax) * 360 / _arcAngleMax + _angleOffset;
+
+	deg = fmodf(deg, 360);
+	if (deg < 0) deg += 360;
+	return deg;
+}
+
+// Sweep in degrees from 'start' to 'end', whole circle if 'end' is at least _arcAngleMax after 'start'
+//---------------------------------------------
+static float _arcSweep(float start, float end)
+{
+	float span = end - start;
+
+	if (span >= _arcAngleMax) return 360;
+	span = fmodf(span, _arcAngleMax);
+	if (span < 0) span += _arcAngleMax;
+	return span * 360 / _arcAngleMax;
+}
 
 //===========================================================================================================================
 void TFT_drawArc(uint16_t cx, uint16_t cy, uint16_t r, uint16_t th, float start, float end, color_t color, color_t fillcolor)
@@ -902,40 +1394,36 @@ void TFT_drawArc(uint16_t cx, uint16_t cy, uint16_t r, uint16_t th, float start,
 
 	int f = TFT_compare_colors(fillcolor, color);
 
-	float astart = fmodf(start, _arcAngleMax);
-	float aend = fmodf(end, _arcAngleMax);
+	float astart = _arcDegrees(start);
+	float sweep = _arcSweep(start, end);
+	float aend = astart + sweep;
 
-	astart += _angleOffset;
-	aend += _angleOffset;
+	_fillArcSector(cx, cy, r, th, astart, sweep, fillcolor);
+	if (f) {
+		_fillArcSector(cx, cy, r, 1, astart, sweep, color);
+		_fillArcSector(cx, cy, r-th, 1, astart, sweep, color);
+	}
+	if ((f) && (sweep < 360)) {
+		int16_t sc = trig_cos(TRIG_DEG(astart)), ss = trig_sin(TRIG_DEG(astart));
+		int16_t ec = trig_cos(TRIG_DEG(aend)), es = trig_sin(TRIG_DEG(aend));
+		_drawLine(cx + TRIG_MUL(r-th, sc), cy + TRIG_MUL(r-th, ss),
+			cx + TRIG_MUL(r-1, sc), cy + TRIG_MUL(r-1, ss), color);
+		_drawLine(cx + TRIG_MUL(r-th, ec), cy + TRIG_MUL(r-th, es),
+			cx + TRIG_MUL(r-1, ec), cy + TRIG_MUL(r-1, es), color);
+	}
+}
 
-	if (astart < 0) astart += (float)360;
-	if (aend < 0) aend += (float)360;
+//================================================================================================================================
+void TFT_updateArc(uint16_t cx, uint16_t cy, uint16_t r, uint16_t th, float from, float to, color_t color, color_t bgcolor)
+{
+	cx += dispWin.x1;
+	cy += dispWin.y1;
 
-	if (aend == 0) aend = (float)360;
+	if (th < 1) th = 1;
+	if (th > r) th = r;
 
-	if (astart > aend) {
-		_fillArcOffsetted(cx, cy, r, th, astart, _arcAngleMax, fillcolor);
-		_fillArcOffsetted(cx, cy, r, th, 0, aend, fillcolor);
-		if (f) {
-			_fillArcOffsetted(cx, cy, r, 1, astart, _arcAngleMax, color);
-			_fillArcOffsetted(cx, cy, r, 1, 0, aend, color);
-			_fillArcOffsetted(cx, cy, r-th, 1, astart, _arcAngleMax, color);
-			_fillArcOffsetted(cx, cy, r-th, 1, 0, aend, color);
-		}
-	}
-	else {
-		_fillArcOffsetted(cx, cy, r, th, astart, aend, fillcolor);
-		if (f) {
-			_fillArcOffsetted(cx, cy, r, 1, astart, aend, color);
-			_fillArcOffsetted(cx, cy, r-th, 1, astart, aend, color);
-		}
-	}
-	if (f) {
-		_drawLine(cx + (r-th) * cos(astart * DEG_TO_RAD), cy + (r-th) * sin(astart * DEG_TO_RAD),
-			cx + (r-1) * cos(astart * DEG_TO_RAD), cy + (r-1) * sin(astart * DEG_TO_RAD), color);
-		_drawLine(cx + (r-th) * cos(aend * DEG_TO_RAD), cy + (r-th) * sin(aend * DEG_TO_RAD),
-			cx + (r-1) * cos(aend * DEG_TO_RAD), cy + (r-1) * sin(aend * DEG_TO_RAD), color);
-	}
+	if (to > from) _fillArcSector(cx, cy, r, th, _arcDegrees(from), _arcSweep(from, to), color);
+	else if (to < from) _fillArcSector(cx, cy, r, th, _arcDegrees(to), _arcSweep(to, from), bgcolor);
 }
 
 //=============================================================================================================
@@ -944,7 +1432,7 @@ void TFT_drawPolygon(int cx, int cy, int sides, int diameter, color_t color, col
 	cx += dispWin.x1;
 	cy += dispWin.y1;
 
-	int deg = rot - _angleOffset;
+	int deg = (int)(rot - _angleOffset) + 180;	// vertex 0 is at 'rot' + 180 degrees
 	int f = TFT_compare_colors(fill, color);
 
 	if (sides < MIN_POLIGON_SIDES) sides = MIN_POLIGON_SIDES;	// This ensures the minimum side number
@@ -954,24 +1442,35 @@ void TFT_drawPolygon(int cx, int cy, int sides, int diameter, color_t color, col
 	int rads = 360 / sides;										// This equally spaces the points.
 
 	for (int idx = 0; idx < sides; idx++) {
-		Xpoints[idx] = cx + sin((float)(idx*rads + deg) * deg_to_rad) * diameter;
-		Ypoints[idx] = cy + cos((float)(idx*rads + deg) * deg_to_rad) * diameter;
+		Xpoints[idx] = cx + TRIG_MUL(diameter, trig_sin(TRIG_DEG(idx*rads + deg)));
+		Ypoints[idx] = cy + TRIG_MUL(diameter, trig_cos(TRIG_DEG(idx*rads + deg)));
 	}
 
 	// Draw the polygon on the screen.
 	if (f) {
-		for(int idx = 0; idx < sides; idx++) {
-			if((idx+1) < sides) _fillTriangle(cx,cy,Xpoints[idx],Ypoints[idx],Xpoints[idx+1],Ypoints[idx+1], fill);
-			else _fillTriangle(cx,cy,Xpoints[idx],Ypoints[idx],Xpoints[0],Ypoints[0], fill);
+		int bx1 = cx, by1 = cy, bx2 = cx, by2 = cy;
+		for (int idx = 0; idx < sides; idx++) {
+			bx1 = min(bx1, Xpoints[idx]);
+			by1 = min(by1, Ypoints[idx]);
+			bx2 = max(bx2, Xpoints[idx]);
+			by2 = max(by2, Ypoints[idx]);
+		}
+		if (_spanBegin(bx1, by1, bx2, by2)) {
+			for(int idx = 0; idx < sides; idx++) {
+				if((idx+1) < sides) _fillTriangle(cx,cy,Xpoints[idx],Ypoints[idx],Xpoints[idx+1],Ypoints[idx+1], fill);
+				else _fillTriangle(cx,cy,Xpoints[idx],Ypoints[idx],Xpoints[0],Ypoints[0], fill);
+			}
+			_spanEnd(fill);
 		}
 	}
 
 	if (th) {
+		_pixBatchBegin();
 		for (int n=0; n<th; n++) {
 			if (n > 0) {
 				for (int idx = 0; idx < sides; idx++) {
-					Xpoints[idx] = cx + sin((float)(idx*rads + deg) * deg_to_rad) * (diameter-n);
-					Ypoints[idx] = cy + cos((float)(idx*rads + deg) * deg_to_rad) * (diameter-n);
+					Xpoints[idx] = cx + TRIG_MUL(diameter-n, trig_sin(TRIG_DEG(idx*rads + deg)));
+					Ypoints[idx] = cy + TRIG_MUL(diameter-n, trig_cos(TRIG_DEG(idx*rads + deg)));
 				}
 			}
 			for(int idx = 0; idx < sides; idx++) {
@@ -981,6 +1480,7 @@ void TFT_drawPolygon(int cx, int cy, int sides, int diameter, color_t color, col
 					_drawLine(Xpoints[idx],Ypoints[idx],Xpoints[0],Ypoints[0], color); // finishes the last line to close up the polygon.
 			}
 		}
+		_pixBatchEnd();
 	}
 }
 
@@ -995,17 +1495,18 @@ void TFT_drawStar(int cx, int cy, int diameter, color_t color, bool fill, float
 	factor = constrain(factor, 1.0, 4.0);
 	uint8_t sides = 5;
 	uint8_t rads = 360 / sides;
+	int inner = (float)(diameter) / factor;
 
 	int Xpoints_O[sides], Ypoints_O[sides], Xpoints_I[sides], Ypoints_I[sides];//Xpoints_T[5], Ypoints_T[5];
 
 	for(int idx = 0; idx < sides; idx++) {
 		// makes the outer points
-		Xpoints_O[idx] = cx + sin((float)(idx*rads + 72) * deg_to_rad) * diameter;
-		Ypoints_O[idx] = cy + cos((float)(idx*rads + 72) * deg_to_rad) * diameter;
+		Xpoints_O[idx] = cx + TRIG_MUL(diameter, trig_sin(TRIG_DEG(idx*rads + 72 + 180)));
+		Ypoints_O[idx] = cy + TRIG_MUL(diameter, trig_cos(TRIG_DEG(idx*rads + 72 + 180)));
 		// makes the inner points
-		Xpoints_I[idx] = cx + sin((float)(idx*rads + 36) * deg_to_rad) * ((float)(diameter)/factor);
+		Xpoints_I[idx] = cx + TRIG_MUL(inner, trig_sin(TRIG_DEG(idx*rads + 36 + 180)));
 		// 36 is half of 72, and this will allow the inner and outer points to line up like a triangle.
-		Ypoints_I[idx] = cy + cos((float)(idx*rads + 36) * deg_to_rad) * ((float)(diameter)/factor);
+		Ypoints_I[idx] = cy + TRIG_MUL(inner, trig_cos(TRIG_DEG(idx*rads + 36 + 180)));
 	}
 
 	for(int idx = 0; idx < sides; idx++) {
@@ -1406,10 +1907,13 @@ static void getMaxWidthHeight()
 
 	cfont.numchars = 0;
 	cfont.max_x_size = 0;
+	memset(glyphIndex, 0, sizeof(glyphIndex));
 
     cc = cfont.font[tempPtr++];
     while (cc != 0xFF)  {
     	cfont.numchars++;
+    	// the first glyph of a character is used, as the sequential search did
+    	if (glyphIndex[cc] == 0) glyphIndex[cc] = tempPtr - 1;
         cy = cfont.font[tempPtr++];
         cw = cfont.font[tempPtr++];
         ch = cfont.font[tempPtr++];
@@ -1429,39 +1933,128 @@ static void getMaxWidthHeight()
     cfont.size = tempPtr;
 }
 
+// ==== Glyph cache ============================================================
+
+#if GLYPH_CACHE_ENTRIES
+//----------------------------------------------------------
+static void _glyphCacheFree(glyph_cache_entry_t *glyph) {
+	heap_caps_free(glyph->pixels);
+	glyphCacheStats.bytes -= glyph->width * glyph->height * TFT_PIXEL_BYTES;
+	glyph->pixels = NULL;
+	glyph->used = 0;
+}
+
+// Find the cached glyph of character 'code' drawn with the current font and colors
+// If it is not cached, an entry with room for its pixels is returned and '*hit' is cleared
+// Returns NULL if the glyph can't be cached
+//---------------------------------------------------------------------------------------------
+static glyph_cache_entry_t *_glyphCacheGet(uint8_t code, uint16_t width, uint16_t height, uint8_t *hit) {
+	glyph_cache_entry_t *glyph;
+	glyph_cache_entry_t *lru;
+	uint8_t fg[TFT_PIXEL_BYTES], bg[TFT_PIXEL_BYTES];
+	uint32_t size = width * height * TFT_PIXEL_BYTES;
+
+	native_color(_fg, fg);
+	native_color(_bg, bg);
+
+	for (int i=0; i<GLYPH_CACHE_ENTRIES; i++) {
+		glyph = &glyphCache[i];
+		if ((glyph->used) && (glyph->font == cfont.font) && (glyph->code == code) &&
+				(glyph->fixed == (font_forceFixed != 0)) && (glyph->width == width) && (glyph->height == height) &&
+				(memcmp(glyph->fg, fg, TFT_PIXEL_BYTES) == 0) && (memcmp(glyph->bg, bg, TFT_PIXEL_BYTES) == 0)) {
+			glyph->used = ++glyphCacheUse;
+			glyphCacheStats.hits++;
+			*hit = 1;
+			return glyph;
+		}
+	}
+
+	*hit = 0;
+	if ((size == 0) || (size > GLYPH_CACHE_SIZE)) return NULL;
+	glyphCacheStats.misses++;
+
+	// Drop the least recently used glyphs until there is a free entry and enough room
+	while (1) {
+		lru = NULL;
+		glyph = NULL;
+		for (int i=0; i<GLYPH_CACHE_ENTRIES; i++) {
+			if (glyphCache[i].used == 0) glyph = &glyphCache[i];
+			else if ((lru == NULL) || (glyphCache[i].used < lru->used)) lru = &glyphCache[i];
+		}
+		if ((glyph) && ((glyphCacheStats.bytes + size) <= GLYPH_CACHE_SIZE)) break;
+		_glyphCacheFree(lru);
+		glyphCacheStats.evictions++;
+	}
+
+	glyph->pixels = heap_caps_malloc(size, MALLOC_CAP_DMA);
+	if (glyph->pixels == NULL) return NULL;
+
+	glyphCacheStats.bytes += size;
+	glyph->used = ++glyphCacheUse;
+	glyph->font = cfont.font;
+	glyph->code = code;
+	glyph->fixed = (font_forceFixed != 0);
+	glyph->width = width;
+	glyph->height = height;
+	memcpy(glyph->fg, fg, TFT_PIXEL_BYTES);
+	memcpy(glyph->bg, bg, TFT_PIXEL_BYTES);
+	return glyph;
+}
+
+// Fill the glyph's pixels with its background color
+//------------------------------------------------------------
+static void _glyphCacheClear(glyph_cache_entry_t *glyph) {
+	for (int n=0; n<(glyph->width * glyph->height); n++) {
+		memcpy(glyph->pixels + (n * TFT_PIXEL_BYTES), glyph->bg, TFT_PIXEL_BYTES);
+	}
+}
+
+// Send the glyph's pixels to the display in one transaction
+//------------------------------------------------------------------------
+static void _glyphCacheSend(glyph_cache_entry_t *glyph, int x, int y) {
+	disp_select();
+	send_raw_data(x, y, x+glyph->width-1, y+glyph->height-1, glyph->width * glyph->height * TFT_PIXEL_BYTES, glyph->pixels);
+	disp_deselect();
+}
+#endif
+
+//===========================================================
+void TFT_getGlyphCacheStats(glyph_cache_stats_t *stats) {
+	memcpy(stats, &glyphCacheStats, sizeof(glyph_cache_stats_t));
+}
+
+//=========================
+void TFT_clearGlyphCache() {
+#if GLYPH_CACHE_ENTRIES
+	for (int i=0; i<GLYPH_CACHE_ENTRIES; i++) {
+		if (glyphCache[i].used) _glyphCacheFree(&glyphCache[i]);
+	}
+#endif
+	memset(&glyphCacheStats, 0, sizeof(glyph_cache_stats_t));
+}
+
 // Return the Glyph data for an individual character in the proportional font
+// The glyph is found through the index built by getMaxWidthHeight() when the font was set
 //------------------------------------
 static uint8_t getCharPtr(uint8_t c) {
-  uint16_t tempPtr = 4; // point at first char data
-
-  do {
-	fontChar.charCode = cfont.font[tempPtr++];
-    if (fontChar.charCode == 0xFF) return 0;
+  uint16_t tempPtr = glyphIndex[c];
 
-    fontChar.adjYOffset = cfont.font[tempPtr++];
-    fontChar.width = cfont.font[tempPtr++];
-    fontChar.height = cfont.font[tempPtr++];
-    fontChar.xOffset = cfont.font[tempPtr++];
-    fontChar.xOffset = fontChar.xOffset < 0x80 ? fontChar.xOffset : -(0xFF - fontChar.xOffset);
-    fontChar.xDelta = cfont.font[tempPtr++];
+  if (tempPtr == 0) return 0;
 
-    if (c != fontChar.charCode && fontChar.charCode != 0xFF) {
-      if (fontChar.width != 0) {
-        // packed bits
-        tempPtr += (((fontChar.width * fontChar.height)-1) / 8) + 1;
-      }
-    }
-  } while ((c != fontChar.charCode) && (fontChar.charCode != 0xFF));
+  fontChar.charCode = cfont.font[tempPtr++];
+  fontChar.adjYOffset = cfont.font[tempPtr++];
+  fontChar.width = cfont.font[tempPtr++];
+  fontChar.height = cfont.font[tempPtr++];
+  fontChar.xOffset = cfont.font[tempPtr++];
+  fontChar.xOffset = fontChar.xOffset < 0x80 ? fontChar.xOffset : -(0xFF - fontChar.xOffset);
+  fontChar.xDelta = cfont.font[tempPtr++];
 
   fontChar.dataPtr = tempPtr;
-  if (c == fontChar.charCode) {
-    if (font_forceFixed > 0) {
-      // fix width & offset for forced fixed width
-      fontChar.xDelta = cfont.max_x_size;
-      fontChar.xOffset = (fontChar.xDelta - fontChar.width) / 2;
-    }
+  if (font_forceFixed > 0) {
+    // fix width & offset for forced fixed width
+    fontChar.xDelta = cfont.max_x_size;
+    fontChar.xOffset = (fontChar.xDelta - fontChar.width) / 2;
   }
-  else return 0;
 
   return 1;
 }
@@ -1515,6 +2108,8 @@ void TFT_setFont(uint8_t font, const char *font_file)
   }
   else {
 	  if (font == USER_FONT) {
+		  // a new user font may be loaded at the same address as the previous one
+		  TFT_clearGlyphCache();
 		  if (load_file_font(font_file, 0) != 0) cfont.font = tft_DefaultFont;
 		  else cfont.font = userfont;
 	  }
@@ -1560,6 +2155,59 @@ void TFT_setFont(uint8_t font, const char *font_file)
 // Character visible pixels rectangle is (xOffset, yOffset) (xOffset+Width-1, yOffset+Height-1)
 //---------------------------------------------------------------------------------------------
 
+// Set the pixels of the proportional character in 'fontChar' to 'fg' in a buffer of display format pixels
+// 'stride' is the buffer's width, pixels right of 'width' or below the font height are skipped
+//----------------------------------------------------------------------------------------
+static void _renderPropGlyph(uint8_t *buf, int stride, int width, const uint8_t *fg) {
+	uint16_t dataPtr = fontChar.dataPtr;
+	uint8_t ch = 0;
+	uint8_t mask = 0x80;
+	int bufX, bufY;
+
+	for (int j=0; j < fontChar.height; j++) {
+		for (int i=0; i < fontChar.width; i++) {
+			if (((i + (j*fontChar.width)) % 8) == 0) {
+				mask = 0x80;
+				ch = cfont.font[dataPtr++];
+			}
+			if ((ch & mask) != 0) {
+				bufX = fontChar.xOffset + i;
+				bufY = j + fontChar.adjYOffset;
+				if ((bufX >= 0) && (bufX < width) && (bufY < cfont.y_size)) {
+					memcpy(buf + (((bufY * stride) + bufX) * TFT_PIXEL_BYTES), fg, TFT_PIXEL_BYTES);
+				}
+			}
+			mask >>= 1;
+		}
+	}
+}
+
+// Set the pixels of fixed font character 'c' to 'fg' in a buffer of display format pixels
+// 'stride' is the buffer's width, pixels right of 'width' are skipped
+//--------------------------------------------------------------------------------------------------
+static void _renderFixedGlyph(uint8_t c, uint8_t *buf, int stride, int width, const uint8_t *fg) {
+	uint8_t fz = (cfont.x_size + 7) / 8;	// bytes per char row
+	uint16_t temp = ((c-cfont.offset)*((fz)*cfont.y_size))+4;
+	uint8_t ch, mask;
+	int bufX;
+
+	if (width > cfont.x_size) width = cfont.x_size;
+	for (int j=0; j<cfont.y_size; j++) {
+		for (int k=0; k < fz; k++) {
+			ch = cfont.font[temp+k];
+			mask = 0x80;
+			for (int i=0; i<8; i++) {
+				bufX = i + (k*8);
+				if (((ch & mask) != 0) && (bufX < width)) {
+					memcpy(buf + (((j * stride) + bufX) * TFT_PIXEL_BYTES), fg, TFT_PIXEL_BYTES);
+				}
+				mask >>= 1;
+			}
+		}
+		temp += (fz);
+	}
+}
+
 // print non-rotated proportional character
 // character is already in fontChar
 //----------------------------------------------
@@ -1572,9 +2220,23 @@ static int printProportionalChar(int x, int y) {
 	if ((font_buffered_char) && (!font_transparent)) {
 		int len, bufPos;
 
+#if GLYPH_CACHE_ENTRIES
+		uint8_t hit;
+		glyph_cache_entry_t *glyph = _glyphCacheGet(fontChar.charCode, char_width, cfont.y_size, &hit);
+		if (glyph) {
+			if (!hit) {
+				// render the Glyph into the cache
+				_glyphCacheClear(glyph);
+				_renderPropGlyph(glyph->pixels, char_width, char_width, glyph->fg);
+			}
+			_glyphCacheSend(glyph, x, y);
+			return char_width;
+		}
+#endif
+
 		// === buffer Glyph data for faster sending ===
 		len = char_width * cfont.y_size;
-		color_t *color_line = heap_caps_malloc(len*3, MALLOC_CAP_DMA);
+		color_t *color_line = (color_t *)TFT_bufLease(TFT_BUF_GLYPH, len*3);
 		if (color_line) {
 			// fill with background color
 			for (int n = 0; n < len; n++) {
@@ -1611,7 +2273,7 @@ static int printProportionalChar(int x, int y) {
 			disp_select();
 			send_data(x, y, x+char_width-1, y+cfont.y_size-1, len, color_line);
 			disp_deselect();
-			free(color_line);
+			TFT_bufReturn(color_line);
 
 			return char_width;
 		}
@@ -1623,7 +2285,7 @@ static int printProportionalChar(int x, int y) {
 
 	// draw Glyph
 	uint8_t mask = 0x80;
-	disp_select();
+	_pixBatchBegin();
 	for (j=0; j < fontChar.height; j++) {
 		for (i=0; i < fontChar.width; i++) {
 			if (((i + (j*fontChar.width)) % 8) == 0) {
@@ -1639,7 +2301,7 @@ static int printProportionalChar(int x, int y) {
 			mask >>= 1;
 		}
 	}
-	disp_deselect();
+	_pixBatchEnd();
 
 	return char_width;
 }
@@ -1658,9 +2320,23 @@ static void printChar(uint8_t c, int x, int y) {
 	temp = ((c-cfont.offset)*((fz)*cfont.y_size))+4;
 
 	if ((font_buffered_char) && (!font_transparent)) {
+#if GLYPH_CACHE_ENTRIES
+		uint8_t hit;
+		glyph_cache_entry_t *glyph = _glyphCacheGet(c, cfont.x_size, cfont.y_size, &hit);
+		if (glyph) {
+			if (!hit) {
+				// render the Glyph into the cache
+				_glyphCacheClear(glyph);
+				_renderFixedGlyph(c, glyph->pixels, cfont.x_size, cfont.x_size, glyph->fg);
+			}
+			_glyphCacheSend(glyph, x, y);
+			return;
+		}
+#endif
+
 		// === buffer Glyph data for faster sending ===
 		len = cfont.x_size * cfont.y_size;
-		color_t *color_line = heap_caps_malloc(len*3, MALLOC_CAP_DMA);
+		color_t *color_line = (color_t *)TFT_bufLease(TFT_BUF_GLYPH, len*3);
 		if (color_line) {
 			// fill with background color
 			for (int n = 0; n < len; n++) {
@@ -1682,7 +2358,7 @@ static void printChar(uint8_t c, int x, int y) {
 			disp_select();
 			send_data(x, y, x+cfont.x_size-1, y+cfont.y_size-1, len, color_line);
 			disp_deselect();
-			free(color_line);
+			TFT_bufReturn(color_line);
 
 			return;
 		}
@@ -1690,7 +2366,7 @@ static void printChar(uint8_t c, int x, int y) {
 
 	if (!font_transparent) _fillRect(x, y, cfont.x_size, cfont.y_size, _bg);
 
-	disp_select();
+	_pixBatchBegin();
 	for (j=0; j<cfont.y_size; j++) {
 		for (k=0; k < fz; k++) {
 			ch = cfont.font[temp+k];
@@ -1706,7 +2382,7 @@ static void printChar(uint8_t c, int x, int y) {
 		}
 		temp += (fz);
 	}
-	disp_deselect();
+	_pixBatchEnd();
 }
 
 // print rotated proportional character
@@ -1714,12 +2390,11 @@ static void printChar(uint8_t c, int x, int y) {
 //---------------------------------------------------
 static int rotatePropChar(int x, int y, int offset) {
   uint8_t ch = 0;
-  double radian = font_rotate * DEG_TO_RAD;
-  float cos_radian = cos(radian);
-  float sin_radian = sin(radian);
+  int32_t cos_q = trig_cos(TRIG_DEG(font_rotate));
+  int32_t sin_q = trig_sin(TRIG_DEG(font_rotate));
 
   uint8_t mask = 0x80;
-  disp_select();
+  _pixBatchBegin();
   for (int j=0; j < fontChar.height; j++) {
     for (int i=0; i < fontChar.width; i++) {
       if (((i + (j*fontChar.width)) % 8) == 0) {
@@ -1727,8 +2402,8 @@ static int rotatePropChar(int x, int y, int offset) {
         ch = cfont.font[fontChar.dataPtr++];
       }
 
-      int newX = (int)(x + (((offset + i) * cos_radian) - ((j+fontChar.adjYOffset)*sin_radian)));
-      int newY = (int)(y + (((j+fontChar.adjYOffset) * cos_radian) + ((offset + i) * sin_radian)));
+      int newX = x + TRIG_MUL(offset + i, cos_q) - TRIG_MUL(j+fontChar.adjYOffset, sin_q);
+      int newY = y + TRIG_MUL(j+fontChar.adjYOffset, cos_q) + TRIG_MUL(offset + i, sin_q);
 
       if ((ch & mask) != 0) _drawPixel(newX,newY,_fg, 0);
       else if (!font_transparent) _drawPixel(newX,newY,_bg, 0);
@@ -1736,7 +2411,7 @@ static int rotatePropChar(int x, int y, int offset) {
       mask >>= 1;
     }
   }
-  disp_deselect();
+  _pixBatchEnd();
 
   return fontChar.xDelta+1;
 }
@@ -1747,23 +2422,22 @@ static void rotateChar(uint8_t c, int x, int y, int pos) {
   uint8_t i,j,ch,fz,mask;
   uint16_t temp;
   int newx,newy;
-  double radian = font_rotate*0.0175;
-  float cos_radian = cos(radian);
-  float sin_radian = sin(radian);
+  int32_t cos_q = trig_cos(TRIG_DEG(font_rotate));
+  int32_t sin_q = trig_sin(TRIG_DEG(font_rotate));
   int zz;
 
   if( cfont.x_size < 8 ) fz = cfont.x_size;
   else fz = cfont.x_size/8;
   temp=((c-cfont.offset)*((fz)*cfont.y_size))+4;
 
-  disp_select();
+  _pixBatchBegin();
   for (j=0; j<cfont.y_size; j++) {
     for (zz=0; zz<(fz); zz++) {
       ch = cfont.font[temp+zz];
       mask = 0x80;
       for (i=0; i<8; i++) {
-        newx=(int)(x+(((i+(zz*8)+(pos*cfont.x_size))*cos_radian)-((j)*sin_radian)));
-        newy=(int)(y+(((j)*cos_radian)+((i+(zz*8)+(pos*cfont.x_size))*sin_radian)));
+        newx=x+TRIG_MUL(i+(zz*8)+(pos*cfont.x_size), cos_q)-TRIG_MUL(j, sin_q);
+        newy=y+TRIG_MUL(j, cos_q)+TRIG_MUL(i+(zz*8)+(pos*cfont.x_size), sin_q);
 
         if ((ch & mask) != 0) _drawPixel(newx,newy,_fg, 0);
         else if (!font_transparent) _drawPixel(newx,newy,_bg, 0);
@@ -1772,10 +2446,10 @@ static void rotateChar(uint8_t c, int x, int y, int pos) {
     }
     temp+=(fz);
   }
-  disp_deselect();
+  _pixBatchEnd();
   // calculate x,y for the next char
-  TFT_X = (int)(x + ((pos+1) * cfont.x_size * cos_radian));
-  TFT_Y = (int)(y + ((pos+1) * cfont.x_size * sin_radian));
+  TFT_X = x + TRIG_MUL((pos+1) * cfont.x_size, cos_q);
+  TFT_Y = y + TRIG_MUL((pos+1) * cfont.x_size, sin_q);
 }
 
 //----------------------
@@ -1943,6 +2617,109 @@ static void _draw7seg(int16_t x, int16_t y, int8_t num, int16_t w, int16_t l, co
 }
 //==============================================================================
 
+// Print a single line string at TFT_X, TFT_Y by composing it in one buffer
+// of string width x font height and sending it in a single transaction
+// Transparent strings are composed over the background read from the shadow framebuffer
+// Returns 0 if the string must be printed character by character:
+// rotated or 7-segment font, multi line or wrapped string, or no memory for the buffer
+//-----------------------------------------
+static int _printBand(char *st, int stl) {
+	int i, bw, bh, bx, cw;
+	int x = TFT_X;
+	int endX = TFT_X;
+	uint8_t ch;
+	uint8_t fg[TFT_PIXEL_BYTES], bg[TFT_PIXEL_BYTES];
+	uint8_t *band;
+
+	if ((cfont.bitmap != 1) || (font_rotate != 0) || (!font_buffered_char)) return 0;
+	if ((font_transparent) && (!shadow_active())) return 0;
+
+	// ** Lay out the characters the same way TFT_print does
+	for (i=0; i<stl; i++) {
+		ch = st[i];
+		if ((ch == 0x0D) || (ch == 0x0A)) return 0;
+		if (cfont.x_size == 0) {
+			if (!getCharPtr(ch)) continue;
+			if ((endX + fontChar.xDelta) > dispWin.x2) break;
+			endX += ((fontChar.width > fontChar.xDelta) ? fontChar.width : fontChar.xDelta) + 1;
+		}
+		else {
+			if ((endX + cfont.x_size) > dispWin.x2) break;
+			endX += cfont.x_size;
+		}
+	}
+	if ((i < stl) && (text_wrap)) return 0;
+	stl = i;
+
+	bw = endX - x;
+	if (cfont.x_size == 0) bw--;	// no spacing after the last character
+	if ((x + bw - 1) > dispWin.x2) bw = dispWin.x2 - x + 1;
+	bh = cfont.y_size;
+	if (bw <= 0) return 1;
+
+	band = TFT_bufLease(TFT_BUF_BAND, bw * bh * TFT_PIXEL_BYTES);
+	if (band == NULL) return 0;
+
+	native_color(_fg, fg);
+	native_color(_bg, bg);
+	if (font_transparent) {
+		if (shadow_read_raw(x, TFT_Y, x+bw-1, TFT_Y+bh-1, band) != 0) {
+			TFT_bufReturn(band);
+			return 0;
+		}
+	}
+	else {
+		for (i=0; i<(bw * bh); i++) memcpy(band + (i * TFT_PIXEL_BYTES), bg, TFT_PIXEL_BYTES);
+	}
+
+	// ** Compose the characters
+	bx = 0;
+	for (i=0; i<stl; i++) {
+		ch = st[i];
+		if (cfont.x_size == 0) {
+			if (!getCharPtr(ch)) continue;
+			cw = ((fontChar.width > fontChar.xDelta) ? fontChar.width : fontChar.xDelta);
+		}
+		else {
+			if ((ch < cfont.offset) || ((ch-cfont.offset) > cfont.numchars)) ch = cfont.offset;
+			cw = cfont.x_size;
+		}
+		if (bx >= bw) break;
+
+#if GLYPH_CACHE_ENTRIES
+		if (!font_transparent) {
+			uint8_t hit;
+			glyph_cache_entry_t *glyph = _glyphCacheGet(ch, cw, bh, &hit);
+			if (glyph) {
+				if (!hit) {
+					_glyphCacheClear(glyph);
+					if (cfont.x_size == 0) _renderPropGlyph(glyph->pixels, cw, cw, glyph->fg);
+					else _renderFixedGlyph(ch, glyph->pixels, cw, cw, glyph->fg);
+				}
+				int n = (((bw - bx) < cw) ? (bw - bx) : cw) * TFT_PIXEL_BYTES;
+				for (int j=0; j<bh; j++) {
+					memcpy(band + (((j * bw) + bx) * TFT_PIXEL_BYTES), glyph->pixels + (j * cw * TFT_PIXEL_BYTES), n);
+				}
+				bx += cw + ((cfont.x_size == 0) ? 1 : 0);
+				continue;
+			}
+		}
+#endif
+		if (cfont.x_size == 0) _renderPropGlyph(band + (bx * TFT_PIXEL_BYTES), bw, bw - bx, fg);
+		else _renderFixedGlyph(ch, band + (bx * TFT_PIXEL_BYTES), bw, bw - bx, fg);
+		bx += cw + ((cfont.x_size == 0) ? 1 : 0);
+	}
+
+	// ** Send the whole line in one transaction
+	disp_select();
+	send_raw_data(x, TFT_Y, x+bw-1, TFT_Y+bh-1, bw * bh * TFT_PIXEL_BYTES, band);
+	disp_deselect();
+	TFT_bufReturn(band);
+
+	TFT_X = endX;
+	return 1;
+}
+
 //======================================
 void TFT_print(char *st, int x, int y) {
 	int stl, i, tmpw, tmph, fh;
@@ -1999,6 +2776,8 @@ void TFT_print(char *st, int x, int y) {
 
 	if ((TFT_Y + tmph - 1) > dispWin.y2) return;
 
+	if (_printBand(st, stl)) return;
+
 	int offset = TFT_OFFSET;
 
 	for (i=0; i<stl; i++) {
@@ -2078,6 +2857,8 @@ void TFT_setRotation(uint8_t rot) {
 	else {
 		orientation = rot;
         _tft_setRotation(rot);
+        // the shadow follows the new orientation's dimensions
+        if (shadow_active()) shadow_enable(1);
 	}
 
 	dispWin.x1 = 0;
@@ -2260,6 +3041,15 @@ void TFT_restoreClipWin()
 
 
 // ================ JPG SUPPORT ================================================
+// Decoded MCU block waiting to be sent
+typedef struct {
+	color_t		*buf;
+	int			x1, y1, x2, y2;
+	uint32_t	len;
+} jpg_block_t;
+
+static tft_jpg_stats_t jpg_stats;
+
 // User defined device identifier
 typedef struct {
 	FILE		*fhndl;			// File handler for input function
@@ -2270,6 +3060,20 @@ typedef struct {
     uint32_t	bufptr;			// memory buffer current position
     color_t		*linbuf[2];		// memory buffer used for display output
     uint8_t		linbuf_idx;
+    jpg_read_cb_t	read;		// stream read function
+    void		*read_arg;
+    // Single producer single consumer ring between the decoder and the calling task
+    jpg_block_t	*ring;			// NULL if decoding on the calling task
+    volatile uint32_t	head;	// blocks decoded, written by the decoder task only
+    volatile uint32_t	tail;	// blocks sent, written by the calling task only
+    volatile uint8_t	done;	// decoder task finished
+    TaskHandle_t	decoder;
+    TaskHandle_t	display;
+    JDEC		*jd;
+    uint8_t		scale;
+    JRESULT		rc;
+    uint64_t	decode_us;
+    uint64_t	decode_wait_us;
 } JPGIODEV;
 
 
@@ -2321,6 +3125,21 @@ static UINT tjd_buf_input (
 	}
 }
 
+// User defined call-back function to input JPEG data from a stream
+//----------------------------
+static UINT tjd_stream_input (
+	JDEC* jd,		// Decompression object
+	BYTE* buff,		// Pointer to the read buffer (NULL:skip)
+	UINT nd			// Number of bytes to read/skip from input stream
+)
+{
+	// Device identifier for the session (5th argument of jd_prepare function)
+	JPGIODEV *dev = (JPGIODEV*)jd->device;
+
+	// Waits only until these bytes have arrived, the rest of the image is received while decoding
+	return dev->read(buff, nd, dev->read_arg);
+}
+
 // User defined call-back function to output RGB bitmap to display device
 //----------------------
 static UINT tjd_output (
@@ -2362,7 +3181,20 @@ static UINT tjd_output (
 
 
 	if ((len > 0) && (len <= JPG_IMAGE_LINE_BUF_SIZE)) {
-		uint8_t *dest = (uint8_t *)(dev->linbuf[dev->linbuf_idx]);
+		uint8_t *dest;
+		jpg_block_t *block = NULL;
+
+		if (dev->ring) {
+			// Wait for a free block; the calling task may also take notifications while sending, so poll
+			if ((dev->head - dev->tail) >= JPG_RING_BLOCKS) {
+				uint64_t t = esp_timer_get_time();
+				while ((dev->head - dev->tail) >= JPG_RING_BLOCKS) ulTaskNotifyTake(pdTRUE, 1);
+				dev->decode_wait_us += esp_timer_get_time() - t;
+			}
+			block = &dev->ring[dev->head % JPG_RING_BLOCKS];
+			dest = (uint8_t *)block->buf;
+		}
+		else dest = (uint8_t *)(dev->linbuf[dev->linbuf_idx]);
 
 		for (y = top; y <= bottom; y++) {
 			for (x = left; x <= right; x++) {
@@ -2375,12 +3207,25 @@ static UINT tjd_output (
 				else src += 3; // skip
 			}
 		}
-		wait_trans_finish(1);
-		send_data(dleft, dtop, dright, dbottom, len, dev->linbuf[dev->linbuf_idx]);
-		dev->linbuf_idx = ((dev->linbuf_idx + 1) & 1);
+		if (block) {
+			block->x1 = dleft;
+			block->y1 = dtop;
+			block->x2 = dright;
+			block->y2 = dbottom;
+			block->len = len;
+			// Block contents must be visible before it is published
+			__sync_synchronize();
+			dev->head++;
+			xTaskNotifyGive(dev->display);
+		}
+		else {
+			wait_trans_finish(1);
+			send_data(dleft, dtop, dright, dbottom, len, dev->linbuf[dev->linbuf_idx]);
+			dev->linbuf_idx = ((dev->linbuf_idx + 1) & 1);
+		}
 	}
 	else {
-		wait_trans_finish(1);
+		if (!dev->ring) wait_trans_finish(1);
 		printf("Data size error: %d jpg: (%d,%d,%d,%d) disp: (%d,%d,%d,%d)\r\n", len, left,top,right,bottom, dleft,dtop,dright,dbottom);
 		return 0;  // stop decompression
 	}
@@ -2388,56 +3233,137 @@ static UINT tjd_output (
 	return 1;	// Continue to decompression
 }
 
-// tft.jpgimage(X, Y, scale, file_name, buf, size]
-// X & Y can be < 0 !
-//==================================================================================
-int TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int size)
+// Decoder task, produces MCU blocks into the ring
+// 'dev' and the ring live on the calling task's stack, so after setting 'done' the task
+// touches neither and waits suspended for the calling task to delete it
+//-----------------------------------------
+static void _jpg_decode_task(void *arg)
+{
+	JPGIODEV *dev = (JPGIODEV *)arg;
+	TaskHandle_t display = dev->display;
+	uint64_t t = esp_timer_get_time();
+
+	dev->rc = jd_decomp(dev->jd, tjd_output, dev->scale);
+	dev->decode_us = esp_timer_get_time() - t - dev->decode_wait_us;
+
+	__sync_synchronize();
+	dev->done = 1;
+	xTaskNotifyGive(display);
+	while (1) vTaskSuspend(NULL);
+}
+
+// Decodes on a task pinned to the other core while this task sends the decoded blocks
+// Each block stays in the ring until its transfer has finished
+// The two line buffers are the first ring blocks, the others are leased here
+// Falls back to decoding on this task if the ring or the task can't be created
+//-------------------------------------------------------------------------
+static JRESULT _jpg_decomp_ring(JDEC *jd, uint8_t scale, JPGIODEV *dev)
+{
+	jpg_block_t ring[JPG_RING_BLOCKS > 0 ? JPG_RING_BLOCKS : 1];
+	uint32_t next = 0;
+	uint64_t start, t;
+	uint64_t busy = 0, wait = 0;
+	int n;
+
+	dev->ring = NULL;
+	if (JPG_RING_BLOCKS == 0) return jd_decomp(jd, tjd_output, scale);
+
+	for (n=0; n<JPG_RING_BLOCKS; n++) {
+		if (n < 2) ring[n].buf = dev->linbuf[n];
+		else ring[n].buf = (color_t *)TFT_bufLease(TFT_BUF_IMAGE, JPG_IMAGE_LINE_BUF_SIZE*3);
+		if (ring[n].buf == NULL) break;
+	}
+	if (n == JPG_RING_BLOCKS) {
+		dev->ring = ring;
+		dev->head = 0;
+		dev->tail = 0;
+		dev->done = 0;
+		dev->jd = jd;
+		dev->scale = scale;
+		dev->decode_wait_us = 0;
+		dev->display = xTaskGetCurrentTaskHandle();
+		start = esp_timer_get_time();
+		if (xTaskCreatePinnedToCore(_jpg_decode_task, "jpg_decode", JPG_DECODE_TASK_STACK, dev,
+				uxTaskPriorityGet(NULL), &dev->decoder, (xPortGetCoreID() == 0) ? 1 : 0) != pdPASS) dev->ring = NULL;
+	}
+	if (dev->ring == NULL) {
+		while (n > 2) TFT_bufReturn(ring[--n].buf);
+		return jd_decomp(jd, tjd_output, scale);
+	}
+
+	while (1) {
+		if (next == dev->head) {
+			if (dev->done) {
+				__sync_synchronize();
+				if (next == dev->head) break;
+				continue;
+			}
+			t = esp_timer_get_time();
+			ulTaskNotifyTake(pdTRUE, 1);
+			wait += esp_timer_get_time() - t;
+			continue;
+		}
+
+		// Block contents are read only after seeing it published
+		__sync_synchronize();
+		t = esp_timer_get_time();
+		jpg_block_t *block = &ring[next % JPG_RING_BLOCKS];
+		// The previous block is sent when its transfer finishes, hand its buffer back
+		wait_trans_finish(1);
+		dev->tail = next;
+		if (!dev->done) xTaskNotifyGive(dev->decoder);
+		send_data(block->x1, block->y1, block->x2, block->y2, block->len, block->buf);
+		next++;
+		busy += esp_timer_get_time() - t;
+	}
+	wait_trans_finish(1);
+
+	// Join the decoder task, it only suspends itself after setting 'done'
+	while (eTaskGetState(dev->decoder) != eSuspended) vTaskDelay(1);
+	vTaskDelete(dev->decoder);
+
+	jpg_stats.images++;
+	jpg_stats.total_us += esp_timer_get_time() - start;
+	jpg_stats.decode_us += dev->decode_us;
+	jpg_stats.decode_wait_us += dev->decode_wait_us;
+	jpg_stats.display_us += busy;
+	jpg_stats.display_wait_us += wait;
+	if (image_debug) printf("Jpg decode %u%% busy, display %u%% busy\r\n",
+			(unsigned)((dev->decode_us * 100) / ((esp_timer_get_time() - start) | 1)),
+			(unsigned)((busy * 100) / ((esp_timer_get_time() - start) | 1)));
+
+	for (n=2; n<JPG_RING_BLOCKS; n++) TFT_bufReturn(ring[n].buf);
+	dev->ring = NULL;
+	return dev->rc;
+}
+
+//============================================
+void TFT_getJpgStats(tft_jpg_stats_t *stats)
+{
+	memcpy(stats, &jpg_stats, sizeof(tft_jpg_stats_t));
+}
+
+// Decodes the image from the source set up in 'dev' and sends it to the display
+// MCU blocks are sent from alternate line buffers, so each one is on the SPI bus
+// while the next one is read and decoded
+//-------------------------------------------------------------------------------------------
+static int _jpg_decode(int x, int y, uint8_t scale, JPGIODEV *dev, UINT (*infunc)(JDEC*, BYTE*, UINT))
 {
 	UINT success = 1;
-	JPGIODEV dev;
-    struct stat sb;
 	char *work = NULL;		// Pointer to the working buffer (must be 4-byte aligned)
 	UINT sz_work = 3800;	// Size of the working buffer (must be power of 2)
 	JDEC jd;				// Decompression object (70 bytes)
 	JRESULT rc;
 
-	dev.linbuf[0] = NULL;
-	dev.linbuf[1] = NULL;
-    dev.linbuf_idx = 0;
-
-   	dev.fhndl = NULL;
-    if (fname == NULL) {
-    	// image from buffer
-        dev.membuff = buf;
-        dev.bufsize = size;
-        dev.bufptr = 0;
-    }
-    else {
-    	// image from file
-        dev.membuff = NULL;
-        dev.bufsize = 0;
-        dev.bufptr = 0;
-
-        if (stat(fname, &sb) != 0) {
-        	if (image_debug) printf("File error: %ss\r\n", strerror(errno));
-        	success = 0;
-            goto exit;
-        }
-
-        dev.fhndl = fopen(fname, "r");
-        if (!dev.fhndl) {
-        	if (image_debug) printf("Error opening file: %s\r\n", strerror(errno));
-        	success = 0;
-            goto exit;
-        }
-    }
+	dev->linbuf[0] = NULL;
+	dev->linbuf[1] = NULL;
+    dev->linbuf_idx = 0;
 
 	if (scale > 3) scale = 3;
 
-	work = malloc(sz_work);
+	work = (char *)TFT_bufLease(TFT_BUF_IMAGE, sz_work);
 	if (work) {
-		if (dev.membuff) rc = jd_prepare(&jd, tjd_buf_input, (void *)work, sz_work, &dev);
-		else rc = jd_prepare(&jd, tjd_input, (void *)work, sz_work, &dev);
+		rc = jd_prepare(&jd, infunc, (void *)work, sz_work, dev);
 		if (rc == JDR_OK) {
 			if (x == CENTER) x = ((dispWin.x2 - dispWin.x1 + 1 - (int)(jd.width >> scale)) / 2) + dispWin.x1;
 			else if (x == RIGHT) x = dispWin.x2 + 1 - (int)(jd.width >> scale);
@@ -2450,17 +3376,17 @@ int TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int si
 			if (x > (dispWin.x2-1)) x = dispWin.x2 - 1;
 			if (y > (dispWin.y2-1)) y = dispWin.y2-1;
 
-			dev.x = x;
-			dev.y = y;
+			dev->x = x;
+			dev->y = y;
 
-			dev.linbuf[0] = heap_caps_malloc(JPG_IMAGE_LINE_BUF_SIZE*3, MALLOC_CAP_DMA);
-			if (dev.linbuf[0] == NULL) {
+			dev->linbuf[0] = (color_t *)TFT_bufLease(TFT_BUF_IMAGE, JPG_IMAGE_LINE_BUF_SIZE*3);
+			if (dev->linbuf[0] == NULL) {
 				if (image_debug) printf("Error allocating line buffer #0\r\n");
 				success = 0;
 				goto exit;
 			}
-			dev.linbuf[1] = heap_caps_malloc(JPG_IMAGE_LINE_BUF_SIZE*3, MALLOC_CAP_DMA);
-			if (dev.linbuf[1] == NULL) {
+			dev->linbuf[1] = (color_t *)TFT_bufLease(TFT_BUF_IMAGE, JPG_IMAGE_LINE_BUF_SIZE*3);
+			if (dev->linbuf[1] == NULL) {
 				if (image_debug) printf("Error allocating line buffer #1\r\n");
 				success = 0;
 				goto exit;
@@ -2468,7 +3394,7 @@ int TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int si
 
 			// Start to decode the JPEG file
 			disp_select();
-			rc = jd_decomp(&jd, tjd_output, scale);
+			rc = _jpg_decomp_ring(&jd, scale, dev);
 			disp_deselect();
 
 			if (rc != JDR_OK) {
@@ -2488,13 +3414,65 @@ int TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int si
 	}
 
 exit:
-	if (work) free(work);  // free work buffer
-	if (dev.linbuf[0]) free(dev.linbuf[0]);
-	if (dev.linbuf[1]) free(dev.linbuf[1]);
+	TFT_bufReturn(work);  // free work buffer
+	TFT_bufReturn(dev->linbuf[0]);
+	TFT_bufReturn(dev->linbuf[1]);
+    return success;
+}
+
+// tft.jpgimage(X, Y, scale, file_name, buf, size]
+// X & Y can be < 0 !
+//==================================================================================
+int TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int size)
+{
+	int success;
+	JPGIODEV dev;
+    struct stat sb;
+
+   	dev.fhndl = NULL;
+    if (fname == NULL) {
+    	// image from buffer
+        dev.membuff = buf;
+        dev.bufsize = size;
+        dev.bufptr = 0;
+    }
+    else {
+    	// image from file
+        dev.membuff = NULL;
+        dev.bufsize = 0;
+        dev.bufptr = 0;
+
+        if (stat(fname, &sb) != 0) {
+        	if (image_debug) printf("File error: %ss\r\n", strerror(errno));
+        	return 0;
+        }
+
+        dev.fhndl = fopen(fname, "r");
+        if (!dev.fhndl) {
+        	if (image_debug) printf("Error opening file: %s\r\n", strerror(errno));
+        	return 0;
+        }
+    }
+
+	if (dev.membuff) success = _jpg_decode(x, y, scale, &dev, tjd_buf_input);
+	else success = _jpg_decode(x, y, scale, &dev, tjd_input);
+
     if (dev.fhndl) fclose(dev.fhndl);  // close input file
     return success;
 }
 
+//=========================================================================
+int TFT_jpg_stream(int x, int y, uint8_t scale, jpg_read_cb_t read, void *arg)
+{
+	JPGIODEV dev;
+
+	memset(&dev, 0, sizeof(JPGIODEV));
+	dev.read = read;
+	dev.read_arg = arg;
+
+	return _jpg_decode(x, y, scale, &dev, tjd_stream_input);
+}
+
 
 //====================================================================================
 int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int size)
@@ -2627,14 +3605,14 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	}
 
 	// ** Allocate memory for 2 lines of image pixels
-	line_buf[0] = heap_caps_malloc(img_xsize*3, MALLOC_CAP_DMA);
+	line_buf[0] = TFT_bufLease(TFT_BUF_IMAGE, img_xsize*3);
 	if (line_buf[0] == NULL) {
 	    sprintf(err_buf, "allocating line buffer #1");
 		err=-12;
 		goto exit;
 	}
 
-	line_buf[1] = heap_caps_malloc(img_xsize*3, MALLOC_CAP_DMA);
+	line_buf[1] = TFT_bufLease(TFT_BUF_IMAGE, img_xsize*3);
 	if (line_buf[1] == NULL) {
 	    sprintf(err_buf, "allocating line buffer #2");
 		err=-13;
@@ -2644,7 +3622,7 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	if (scale) {
 		// Allocate memory for scale buffer
 		rd_len = img_xlen * 3 * scale_pix;
-		scale_buf = malloc(rd_len*scale_pix);
+		scale_buf = TFT_bufLease(TFT_BUF_IMAGE, rd_len*scale_pix);
 		if (scale_buf == NULL) {
 			sprintf(err_buf, "allocating scale buffer");
 			err=-14;
@@ -2766,9 +3744,9 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 exit1:
 	disp_deselect();
 exit:
-	if (scale_buf) free(scale_buf);
-	if (line_buf[0]) free(line_buf[0]);
-	if (line_buf[1]) free(line_buf[1]);
+	TFT_bufReturn(scale_buf);
+	TFT_bufReturn(line_buf[0]);
+	TFT_bufReturn(line_buf[1]);
 	if (fhndl) fclose(fhndl);
 	if ((err) && (image_debug)) printf("Error: %d [%s]\r\n", err, err_buf);
 
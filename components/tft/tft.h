@@ -29,6 +29,13 @@ typedef struct {
 	color_t     color;
 } Font;
 
+typedef struct {
+	uint32_t hits;			// characters sent from the cache
+	uint32_t misses;		// characters rendered into the cache
+	uint32_t evictions;		// glyphs dropped to make room
+	uint32_t bytes;			// pixel memory currently used
+} glyph_cache_stats_t;
+
 
 //==========================================================================================
 // ==== Global variables ===================================================================
@@ -45,6 +52,7 @@ extern color_t   _bg;            	// current background for non transparent font
 extern dispWin_t dispWin;			// display clip window
 extern float	  _angleOffset;		// angle offset for arc, polygon and line by angle functions
 extern uint8_t	  image_debug;		// print debug messages during image decode if set to 1
+extern uint8_t	  fill_box;			// if not 0 filled shapes also fill the rest of their bounding box with _bg
 
 extern Font cfont;					// Current font structure
 
@@ -61,6 +69,28 @@ extern uint32_t tp_caly;			// touch screen Y calibration constant
 // The size must be multiple of 256 bytes !!
 #define JPG_IMAGE_LINE_BUF_SIZE 512
 
+// JPG images are decoded by a task on the other core, which hands MCU blocks
+// to the calling task through a ring of JPG_RING_BLOCKS line buffers
+// Set JPG_RING_BLOCKS to 0 to decode and send on the calling task
+#define JPG_RING_BLOCKS			4
+#define JPG_DECODE_TASK_STACK	4096
+
+// Time spent by the two JPG stages, utilization of a stage is its busy time / total_us
+typedef struct {
+	uint32_t images;			// images decoded on two cores
+	uint64_t total_us;			// decoder task start until the last block is sent
+	uint64_t decode_us;			// decoder task busy, decoding and converting colors
+	uint64_t decode_wait_us;	// decoder task waiting for a free block
+	uint64_t display_us;		// calling task busy, sending blocks to the display
+	uint64_t display_wait_us;	// calling task waiting for a decoded block
+} tft_jpg_stats_t;
+
+// Rendered glyphs of non transparent buffered characters are kept in DMA capable memory,
+// keyed by font, character and colors, and the least recently used are dropped when full
+// Set GLYPH_CACHE_ENTRIES to 0 to render every character again
+#define GLYPH_CACHE_ENTRIES		32
+#define GLYPH_CACHE_SIZE		(16*1024)	// maximum pixel memory used by the cache, in bytes
+
 // --- Constants for ellipse function ---
 #define TFT_ELLIPSE_UPPER_RIGHT 0x01
 #define TFT_ELLIPSE_UPPER_LEFT  0x02
@@ -145,6 +175,18 @@ extern const color_t TFT_PINK;
 //-------------------------------------------------------------------
 void TFT_drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel);
 
+/*
+ * Draw pixels of the same color at given points
+ * Pixels are sorted and adjacent ones on a row are sent as one run, all in one CS activation
+ *
+ * Params:
+ *  points: array of x,y positions
+ *   count: number of points
+ *   color: pixel color
+*/
+//----------------------------------------------------------------
+void TFT_drawPixels(tft_point_t *points, int count, color_t color);
+
 /*
  * Read pixel color value from display GRAM at given x,y coordinates
  * 
@@ -184,6 +226,116 @@ void TFT_drawFastHLine(int16_t x, int16_t y, int16_t w, color_t color);
 
 void TFT_drawFastHLineBuffer(int16_t x, int16_t y, int16_t w, color_t * color);
 
+/*
+ * Push a rectangular block of colors to the display
+ * The address window is set once and the whole block is streamed
+ * in a single RAMWR using chained DMA descriptors
+ *
+ * Params:
+ *       x: horizontal rect start position
+ *       y: vertical rect start position
+ *       w: rectangle width
+ *       h: rectangle height
+ *     buf: w*h colors, row by row; must be DMA capable
+*/
+//-------------------------------------------------------------------------
+void TFT_blitRect(int16_t x, int16_t y, int16_t w, int16_t h, color_t *buf);
+
+/*
+ * Push a w*h block of pixels already in display format (RGB565 or RGB666,
+ * TFT_PIXEL_BYTES per pixel) clipped to the display window, no conversion is done
+ *
+ * Params:
+ *       x: horizontal rect start position
+ *       y: vertical rect start position
+ *       w: rectangle width
+ *       h: rectangle height
+ *     buf: w*h*TFT_PIXEL_BYTES bytes, row by row; must be DMA capable
+*/
+//-------------------------------------------------------------------------
+void TFT_blitRaw(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t *buf);
+
+/*
+ * Queue a w*h block of pixels in display format and return without waiting
+ * Queued blocks are sent back to back by the spi interrupt while the drawing task prepares the next one
+ * Blocks partly outside the display window are pushed synchronously
+ * If the transaction queue is full the calling task sleeps until there is room
+ * The display stays selected until TFT_flushAsync() or any synchronous drawing function
+ *
+ * Params:
+ *       x: horizontal rect start position
+ *       y: vertical rect start position
+ *       w: rectangle width
+ *       h: rectangle height
+ *     buf: w*h*TFT_PIXEL_BYTES bytes, DMA capable, unchanged until the transfer completes
+ *      cb: called from interrupt context when the block is sent, may be NULL
+ *     arg: argument passed to 'cb'
+ *
+ * Returns:
+ *      transfer handle, 0 if the block was already pushed synchronously or could not be sent
+*/
+//-------------------------------------------------------------------------------------------------------------------
+tft_async_t TFT_submitRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t *buf, tft_async_cb_t cb, void *arg);
+
+/*
+ * Wait until the transfer started by TFT_submitRect completes, the calling task sleeps meanwhile
+ *
+ * Params:
+ *  handle: handle returned by TFT_submitRect
+ * timeout: maximum time to wait in ticks, portMAX_DELAY to wait forever
+ *
+ * Returns:
+ *      ESP_OK if completed, ESP_ERR_TIMEOUT otherwise
+*/
+//------------------------------------------------------------
+esp_err_t TFT_waitAsync(tft_async_t handle, TickType_t timeout);
+
+/*
+ * Wait for all submitted transfers and release the display
+ * Must be called from the task which submitted the transfers
+*/
+//--------------------------
+esp_err_t TFT_flushAsync();
+
+/*
+ * Get the glyph cache counters
+ *
+ * Params:
+ *   stats: pointer to glyph_cache_stats_t structure to fill
+*/
+//-----------------------------------------------------
+void TFT_getGlyphCacheStats(glyph_cache_stats_t *stats);
+
+/*
+ * Drop all cached glyphs and reset the counters
+*/
+//-------------------------
+void TFT_clearGlyphCache();
+
+/*
+ * Enable or disable the shadow framebuffer
+ * While enabled all drawing functions draw to a framebuffer in RAM and
+ * nothing is sent to the display until TFT_flush(); TFT_readPixel reads from it
+ * The shadow starts black, the first TFT_flush() overwrites the whole display
+ * Disabling it flushes pending changes and frees the framebuffer
+ *
+ * Params:
+ *  enable: 1 to enable, 0 to disable
+ *
+ * Returns:
+ *      ESP_OK, ESP_ERR_NO_MEM if the framebuffer could not be allocated
+*/
+//--------------------------------------
+esp_err_t TFT_setShadow(uint8_t enable);
+
+/*
+ * Send the changes drawn to the shadow framebuffer since the last flush
+ * Changed tiles are merged into rectangles, each sent in a single RAMWR
+ * Does nothing if the shadow framebuffer is not enabled
+*/
+//---------------
+void TFT_flush();
+
 /*
  * Draw line on screen
  * 
@@ -197,6 +349,18 @@ void TFT_drawFastHLineBuffer(int16_t x, int16_t y, int16_t w, color_t * color);
 //-------------------------------------------------------------------------------
 void TFT_drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, color_t color);
 
+/*
+ * Draw connected lines through the given points
+ * Single pixels of all lines are collected and sent together, see TFT_drawPixels()
+ *
+ * Params:
+ *  points: array of x,y positions
+ *   count: number of points
+ *   color: line color
+*/
+//------------------------------------------------------------------
+void TFT_drawPolyline(tft_point_t *points, int count, color_t color);
+
 
 /*
  * Draw line on screen from (x,y) point at given angle
@@ -400,6 +564,25 @@ void TFT_fillEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 void TFT_drawArc(uint16_t cx, uint16_t cy, uint16_t r, uint16_t th, float start, float end, color_t color, color_t fillcolor);
 
 
+/*
+ * Redraw only the changed part of a filled arc, e.g. a progress ring drawn with TFT_drawArc
+ * Arc end moved from 'from' to 'to': the sector between them is filled with 'color' if the arc grew,
+ * with 'bgcolor' if it shrank. Only pixels between the old and the new end are drawn.
+ *
+ * Params:
+ *        cx: arc center X position
+ *        cy: arc center Y position
+ *         r: arc radius
+ *        th: thickness of the arc
+ *      from: previous arc end angle
+ *        to: new arc end angle
+ *     color: arc fill color
+ *   bgcolor: background color
+*/
+//--------------------------------------------------------------------------------------------------------------------------------
+void TFT_updateArc(uint16_t cx, uint16_t cy, uint16_t r, uint16_t th, float from, float to, color_t color, color_t bgcolor);
+
+
 /*
  * Draw polygon on screen
  *
@@ -622,6 +805,35 @@ color_t HSBtoRGB(float _hue, float _sat, float _brightness);
 //-----------------------------------------------------------------------------------
 int TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int size);
 
+/*
+ * Reads the next 'len' bytes of a JPG stream into 'buf', or skips them if 'buf' is NULL
+ * Returns the number of bytes read, 0 if the stream has ended or failed
+ */
+typedef uint32_t (*jpg_read_cb_t)(uint8_t *buf, uint32_t len, void *arg);
+
+/*
+ * Decodes and displays JPG image read from a stream, e.g. a network response
+ * Data is requested only as the decoder needs it, so the image is decoded
+ * and sent to the display while the rest of it is still being received
+ * Limits are the same as for TFT_jpg_image
+ *
+ * Params:
+ *       x: image left position; constants CENTER & RIGHT can be used; negative value is accepted
+ *       y: image top position;  constants CENTER & BOTTOM can be used; negative value is accepted
+ *   scale: image scale factor: 0~3; if scale>0, image is scaled by factor 1/(2^scale) (1/2, 1/4 or 1/8)
+ *    read: function reading the stream
+ *     arg: passed to 'read'
+ *
+ */
+//---------------------------------------------------------------------------
+int TFT_jpg_stream(int x, int y, uint8_t scale, jpg_read_cb_t read, void *arg);
+
+/*
+ * Copy the accumulated JPG stage times to 'stats'
+ */
+//============================================
+void TFT_getJpgStats(tft_jpg_stats_t *stats);
+
 /*
  * Decodes and displays BMP image
  * Only uncompressed RGB 24-bit with no color space information BMP images can be displayed
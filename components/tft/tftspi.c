@@ -15,6 +15,7 @@
 #include "esp_heap_caps.h"
 #include "soc/spi_reg.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 
 
 // ====================================================
@@ -39,9 +40,91 @@ spi_lobo_device_handle_t ts_spi = NULL;
 // ====================================================
 
 
-static color_t *trans_cline = NULL;
 static uint8_t _dma_sending = 0;
 
+// Lines of solid color used for repeated color fills, the most recently used colors are kept
+#define FILL_CACHE_LINES	4
+#define FILL_LINE_PIXELS	640
+// Repeated color fills up to this size are sent from spi data buffer, without DMA
+#define FILL_DIRECT_BYTES	256
+
+typedef struct {
+	uint8_t *buf;					// FILL_LINE_PIXELS pixels, DMA capable
+	uint8_t pix[TFT_PIXEL_BYTES];	// color in display's pixel format
+	uint32_t used;					// last use, the least recently used line is replaced
+} fill_line_t;
+
+static fill_line_t fill_cache[FILL_CACHE_LINES];
+static uint32_t fill_stamp = 0;
+
+#if TFT_SPI_COST
+static tft_spi_cost_t _spi_cost = {0};
+#define SPI_COST(field, n)	(_spi_cost.field += (n))
+#else
+#define SPI_COST(field, n)
+#endif
+
+// Async transfers are queued on the display's spi transaction queue
+// Each block is queued as CASET, PASET & RAMWR commands with their data, followed by the pixel data
+// The queue's 'user' field holds the DC level and marks the last transaction of a block
+#define TFT_QUEUE_DEPTH		24
+#define TFT_QUEUE_DATA		((void *)1)		// DC high, data
+#define TFT_QUEUE_CMD		((void *)0)		// DC low, command
+#define TFT_QUEUE_END		((void *)3)		// data, last transaction of the block
+
+typedef struct {
+	tft_async_t handle;
+	tft_async_cb_t cb;
+	void *arg;
+} tft_async_block_t;
+
+static uint8_t _queue_ok = 0;
+static tft_async_block_t _async_blocks[TFT_QUEUE_DEPTH];	// blocks in flight, in queue order
+static volatile int _async_blk_head = 0;
+static volatile int _async_blk_tail = 0;
+static tft_async_t _async_last = 0;			// last submitted handle
+static volatile tft_async_t _async_done = 0;	// last completed handle
+static volatile TaskHandle_t _async_waiter = NULL;
+
+// Number of pixels converted per DMA transfer when sending color_t buffers
+// Two such blocks are used, one is converted while the other is being sent
+#define CONV_BUF_PIXELS	256
+static uint8_t *conv_buf = NULL;
+static uint32_t conv_us = 0;		// color conversion time, see TFT_takeConvertTime()
+
+// Shadow framebuffer, when allocated all drawing goes to it instead of the display
+// Changes are tracked per TFT_SHADOW_TILE x TFT_SHADOW_TILE tile, one bit per tile
+// and one 32-bit word per tile row, and sent to the display by shadow_flush()
+#define SHADOW_MAX_COLS		32
+#define SHADOW_STAGE_BYTES	4096	// two such blocks are used for sending partial width rectangles
+#define SHADOW_CONV_PIXELS	32
+
+typedef struct {
+	int x1, y1, x2, y2;		// address window
+	int x, y;				// next pixel written
+	uint8_t ok;
+} shadow_win_t;
+
+static uint8_t *_shadow_fb = NULL;		// _shadow_w * _shadow_h pixels in display's pixel format, DMA capable
+static uint32_t *_shadow_dirty = NULL;
+static uint8_t *_shadow_stage = NULL;
+static int _shadow_w = 0;
+static int _shadow_h = 0;
+static int _shadow_rows = 0;
+static shadow_win_t _shadow_win;
+
+// DMA buffer pool, one bit per leased block
+static uint8_t *pool_mem = NULL;
+static uint32_t pool_map = 0;
+static uint8_t pool_len[TFT_POOL_BLOCKS];		// blocks of the lease starting at the block
+static uint8_t pool_type[TFT_POOL_BLOCKS];		// type of the lease starting at the block
+static tft_pool_stats_t pool_stats;
+static portMUX_TYPE pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Rows generated by TFT_pushRows() are filled into one block while the other one is being sent
+#define ROWS_BUF_BYTES		4096
+static uint8_t *rows_buf = NULL;
+
 // RGB to GRAYSCALE constants
 // 0.2989  0.5870  0.1140
 #define GS_FACT_R 0.2989
@@ -52,27 +135,30 @@ static uint8_t _dma_sending = 0;
 
 // ==== Functions =====================
 
+//--------------------------------
+static void IRAM_ATTR _dma_reset()
+{
+    //Tell common code DMA workaround that our DMA channel is idle. If needed, the code will do a DMA reset.
+    if (disp_spi->host->dma_chan) spi_lobo_dmaworkaround_idle(disp_spi->host->dma_chan);
+
+    // Reset DMA
+	disp_spi->host->hw->dma_conf.val |= SPI_OUT_RST|SPI_IN_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST;
+	disp_spi->host->hw->dma_out_link.start=0;
+	disp_spi->host->hw->dma_in_link.start=0;
+	disp_spi->host->hw->dma_conf.val &= ~(SPI_OUT_RST|SPI_IN_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST);
+	disp_spi->host->hw->dma_conf.out_data_burst_en=1;
+	_dma_sending = 0;
+}
+
 //------------------------------------------------------
 esp_err_t IRAM_ATTR wait_trans_finish(uint8_t free_line)
 {
+	// Wait for queued transfers to complete, the task sleeps meanwhile
+	spi_lobo_queue_wait_idle(disp_spi, portMAX_DELAY);
+
 	// Wait for SPI bus ready
 	while (disp_spi->host->hw->cmd.usr);
-	if ((free_line) && (trans_cline)) {
-		free(trans_cline);
-		trans_cline = NULL;
-	}
-	if (_dma_sending) {
-	    //Tell common code DMA workaround that our DMA channel is idle. If needed, the code will do a DMA reset.
-	    if (disp_spi->host->dma_chan) spi_lobo_dmaworkaround_idle(disp_spi->host->dma_chan);
-
-	    // Reset DMA
-		disp_spi->host->hw->dma_conf.val |= SPI_OUT_RST|SPI_IN_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST;
-		disp_spi->host->hw->dma_out_link.start=0;
-		disp_spi->host->hw->dma_in_link.start=0;
-		disp_spi->host->hw->dma_conf.val &= ~(SPI_OUT_RST|SPI_IN_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST);
-		disp_spi->host->hw->dma_conf.out_data_burst_en=1;
-		_dma_sending = 0;
-	}
+	if (_dma_sending) _dma_reset();
     return ESP_OK;
 }
 
@@ -106,6 +192,7 @@ static void IRAM_ATTR _spi_transfer_start(spi_lobo_device_handle_t spi_dev, int
     }
 	// Start transfer
 	spi_dev->host->hw->cmd.usr = 1;
+	SPI_COST(transactions, 1);
     // Wait for SPI bus ready
 	while (spi_dev->host->hw->cmd.usr);
 }
@@ -121,6 +208,7 @@ void IRAM_ATTR disp_spi_transfer_cmd(int8_t cmd) {
 
     disp_spi->host->hw->data_buf[0] = (uint32_t)cmd;
     _spi_transfer_start(disp_spi, 8, 0);
+	SPI_COST(commands, 1);
 }
 
 // Send command with data to display, display must be selected
@@ -134,8 +222,10 @@ void IRAM_ATTR disp_spi_transfer_cmd_data(int8_t cmd, uint8_t *data, uint32_t le
 
     disp_spi->host->hw->data_buf[0] = (uint32_t)cmd;
     _spi_transfer_start(disp_spi, 8, 0);
+	SPI_COST(commands, 1);
 
 	if ((len == 0) || (data == NULL)) return;
+	SPI_COST(data_bytes, len);
 
     // Set DC to 1 (data mode);
 	gpio_set_level(PIN_NUM_DC, 1);
@@ -221,6 +311,11 @@ static void IRAM_ATTR disp_spi_transfer_addrwin(uint16_t x1, uint16_t x2, uint16
 	disp_spi->host->hw->cmd.usr = 1; // Start transfer
 	while (disp_spi->host->hw->cmd.usr);
     taskENABLE_INTERRUPTS();
+
+	SPI_COST(windows, 1);
+	SPI_COST(commands, 2);
+	SPI_COST(data_bytes, 8);
+	SPI_COST(transactions, 4);
 }
 
 // Convert color to gray scale
@@ -238,12 +333,164 @@ static color_t IRAM_ATTR color2gs(color_t color)
     return _color;
 }
 
+// Convert color to the display's interface pixel format (TFT_PIXEL_BYTES bytes)
+//---------------------------------------------------------------------
+static inline void IRAM_ATTR color2native(color_t color, uint8_t *pix)
+{
+#if TFT_COLOR_BITS == 16
+	pix[0] = (color.r & 0xF8) | (color.g >> 5);
+	pix[1] = ((color.g & 0x1C) << 3) | (color.b >> 3);
+#else
+	pix[0] = color.r;
+	pix[1] = color.g;
+	pix[2] = color.b;
+#endif
+}
+
+// ==== Shadow framebuffer drawing ===============================
+
+// Mark the tiles covering the rectangle as changed
+//-------------------------------------------------------------------
+static void IRAM_ATTR _shadow_mark(int x1, int y1, int x2, int y2)
+{
+	int c1 = x1 / TFT_SHADOW_TILE;
+	int c2 = x2 / TFT_SHADOW_TILE;
+	uint32_t mask = ((c2-c1+1) >= 32) ? 0xFFFFFFFF : (((1u << (c2-c1+1)) - 1) << c1);
+
+	for (int r = y1 / TFT_SHADOW_TILE; r <= (y2 / TFT_SHADOW_TILE); r++) {
+		_shadow_dirty[r] |= mask;
+	}
+}
+
+// Set the shadow's address window, the same way CASET & PASET set the display's
+//----------------------------------------------------------------------
+static void IRAM_ATTR _shadow_window(int x1, int y1, int x2, int y2)
+{
+	if (x2 >= _shadow_w) x2 = _shadow_w-1;
+	if (y2 >= _shadow_h) y2 = _shadow_h-1;
+	_shadow_win.ok = ((x1 >= 0) && (y1 >= 0) && (x1 <= x2) && (y1 <= y2));
+	_shadow_win.x1 = x1;
+	_shadow_win.y1 = y1;
+	_shadow_win.x2 = x2;
+	_shadow_win.y2 = y2;
+	_shadow_win.x = x1;
+	_shadow_win.y = y1;
+}
+
+// Fill 'n' pixels at 'dst' with the pixel 'pix', copying the already filled part
+//-----------------------------------------------------------------------------
+static void IRAM_ATTR _shadow_fill(uint8_t *dst, uint8_t *pix, uint32_t n)
+{
+	uint32_t done = TFT_PIXEL_BYTES;
+	uint32_t total = n * TFT_PIXEL_BYTES;
+	uint32_t count;
+
+	memcpy(dst, pix, TFT_PIXEL_BYTES);
+	while (done < total) {
+		count = ((done < (total - done)) ? done : (total - done));
+		memcpy(dst + done, dst, count);
+		done += count;
+	}
+}
+
+// Write 'len' pixels in display's pixel format to the shadow's address window
+// If 'rep' is set the single pixel 'src' is written 'len' times
+//-----------------------------------------------------------------------------
+static void IRAM_ATTR _shadow_put(uint8_t *src, uint32_t len, uint8_t rep)
+{
+	shadow_win_t *win = &_shadow_win;
+	uint32_t n;
+	uint8_t *dst;
+
+	if ((!win->ok) || (len == 0)) return;
+	_shadow_mark(win->x1, win->y1, win->x2, win->y2);
+
+	while (len > 0) {
+		n = win->x2 - win->x + 1;
+		if (n > len) n = len;
+		dst = _shadow_fb + (((win->y * _shadow_w) + win->x) * TFT_PIXEL_BYTES);
+		if (rep) _shadow_fill(dst, src, n);
+		else {
+			memcpy(dst, src, n * TFT_PIXEL_BYTES);
+			src += n * TFT_PIXEL_BYTES;
+		}
+		len -= n;
+		win->x += n;
+		if (win->x > win->x2) {
+			win->x = win->x1;
+			if (++win->y > win->y2) win->y = win->y1;
+		}
+	}
+}
+
+// Write 'len' colors to the shadow's address window, converted to display's pixel format
+//---------------------------------------------------------------------------------
+static void IRAM_ATTR _shadow_put_colors(color_t *color, uint32_t len, uint8_t rep)
+{
+	uint8_t pix[SHADOW_CONV_PIXELS * TFT_PIXEL_BYTES];
+	uint32_t n;
+
+	if (rep) {
+		color2native((gray_scale) ? color2gs(color[0]) : color[0], pix);
+		_shadow_put(pix, len, 1);
+		return;
+	}
+	while (len > 0) {
+		n = ((len > SHADOW_CONV_PIXELS) ? SHADOW_CONV_PIXELS : len);
+		for (uint32_t i=0; i<n; i++) {
+			color2native((gray_scale) ? color2gs(color[i]) : color[i], pix + (i*TFT_PIXEL_BYTES));
+		}
+		_shadow_put(pix, n, 0);
+		color += n;
+		len -= n;
+	}
+}
+
+// Read 'len' colors from the shadow's window, in the format read_data() returns them
+//-------------------------------------------------------------------------------------
+static void IRAM_ATTR _shadow_read(int x1, int y1, int x2, int y2, int len, uint8_t *buf)
+{
+	uint8_t *pix;
+
+	_shadow_window(x1, y1, x2, y2);
+	if (!_shadow_win.ok) return;
+
+	buf++;	// dummy byte
+	while (len-- > 0) {
+		pix = _shadow_fb + (((_shadow_win.y * _shadow_w) + _shadow_win.x) * TFT_PIXEL_BYTES);
+#if TFT_COLOR_BITS == 16
+		buf[0] = pix[0] & 0xF8;
+		buf[1] = ((pix[0] & 0x07) << 5) | ((pix[1] & 0xE0) >> 3);
+		buf[2] = pix[1] << 3;
+#else
+		memcpy(buf, pix, 3);
+#endif
+		buf += 3;
+		if (++_shadow_win.x > _shadow_win.x2) {
+			_shadow_win.x = _shadow_win.x1;
+			if (++_shadow_win.y > _shadow_win.y2) _shadow_win.y = _shadow_win.y1;
+		}
+	}
+}
+
+//==================================================
+void IRAM_ATTR native_color(color_t color, uint8_t *pix)
+{
+	color2native((gray_scale) ? color2gs(color) : color, pix);
+}
+
 // Set display pixel at given coordinates to given color
 //------------------------------------------------------------------------
 void IRAM_ATTR drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel)
 {
 	if (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX)) return;
 
+	if (_shadow_fb) {
+		_shadow_window(x, y, x, y);
+		_shadow_put_colors(&color, 1, 1);
+		return;
+	}
+
 	if (sel) {
 		if (disp_select()) return;
 	}
@@ -251,7 +498,9 @@ void IRAM_ATTR drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel)
 
 	uint32_t wd = 0;
     color_t _color = color;
+	uint8_t pix[TFT_PIXEL_BYTES];
 	if (gray_scale) _color = color2gs(color);
+	color2native(_color, pix);
 
     taskDISABLE_INTERRUPTS();
 	disp_spi_transfer_addrwin(x, x+1, y, y+1);
@@ -263,22 +512,215 @@ void IRAM_ATTR drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel)
 	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
 	while (disp_spi->host->hw->cmd.usr);	// Wait for SPI bus ready
 
-	wd = (uint32_t)_color.r;
-	wd |= (uint32_t)_color.g << 8;
-	wd |= (uint32_t)_color.b << 16;
+	for (int n=0; n<TFT_PIXEL_BYTES; n++) {
+		wd |= (uint32_t)pix[n] << (n*8);
+	}
 
     // Set DC to 1 (data mode);
 	gpio_set_level(PIN_NUM_DC, 1);
 
 	disp_spi->host->hw->data_buf[0] = wd;
-	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = 23;
+	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = (TFT_PIXEL_BYTES*8)-1;
 	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
 	while (disp_spi->host->hw->cmd.usr);	// Wait for SPI bus ready
 
     taskENABLE_INTERRUPTS();
+	SPI_COST(commands, 1);
+	SPI_COST(data_bytes, TFT_PIXEL_BYTES);
+	SPI_COST(transactions, 2);
    if (sel) disp_deselect();
 }
 
+// Sort points by rows, then by columns
+//----------------------------------------------------
+static int _point_cmp(const void *a, const void *b)
+{
+	const tft_point_t *pa = (const tft_point_t *)a;
+	const tft_point_t *pb = (const tft_point_t *)b;
+
+	if (pa->y != pb->y) return pa->y - pb->y;
+	return pa->x - pb->x;
+}
+
+// Find the run of adjacent points on one row starting at sorted point 'n'
+// Returns index of the first point after the run, run's last column in 'x2'
+//--------------------------------------------------------------------------
+static int _point_run(tft_point_t *points, int count, int n, int16_t *x2)
+{
+	int16_t y = points[n].y;
+
+	*x2 = points[n].x;
+	for (n++; (n < count) && (points[n].y == y) && (points[n].x <= (*x2 + 1)); n++) {
+		*x2 = points[n].x;
+	}
+	return n;
+}
+
+// Send CASET or PASET command with its start and end value
+// ** Device must already be selected, interrupts disabled **
+//-------------------------------------------------------------------------
+static void IRAM_ATTR _send_range(uint8_t cmd, uint16_t start, uint16_t end)
+{
+	uint32_t wd;
+
+	while (disp_spi->host->hw->cmd.usr);
+	gpio_set_level(PIN_NUM_DC, 0);
+	disp_spi->host->hw->data_buf[0] = (uint32_t)cmd;
+	disp_spi->host->hw->user.usr_mosi_highpart = 0;
+	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = 7;
+	disp_spi->host->hw->user.usr_mosi = 1;
+	disp_spi->host->hw->miso_dlen.usr_miso_dbitlen = 0;
+	disp_spi->host->hw->user.usr_miso = 0;
+	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
+
+	wd = (uint32_t)(start>>8);
+	wd |= (uint32_t)(start&0xff) << 8;
+	wd |= (uint32_t)(end>>8) << 16;
+	wd |= (uint32_t)(end&0xff) << 24;
+
+	while (disp_spi->host->hw->cmd.usr);
+	gpio_set_level(PIN_NUM_DC, 1);
+	disp_spi->host->hw->data_buf[0] = wd;
+	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = 31;
+	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
+	while (disp_spi->host->hw->cmd.usr);
+
+	SPI_COST(commands, 1);
+	SPI_COST(data_bytes, 4);
+	SPI_COST(transactions, 2);
+}
+
+// Pixel pattern and current window of a run session, see _send_run()
+typedef struct {
+	uint32_t pat[16];
+	int burst;			// pixels sent from spi data buffer at once
+	int wx1, wx2, wy;
+} run_session_t;
+
+//-----------------------------------------------------------
+static void _run_begin(run_session_t *rs, color_t color)
+{
+	uint8_t *pat_bytes = (uint8_t *)rs->pat;
+	uint8_t pix[TFT_PIXEL_BYTES];
+
+	rs->burst = sizeof(rs->pat) / TFT_PIXEL_BYTES;
+	rs->wx1 = -1;
+	rs->wx2 = -1;
+	rs->wy = -1;
+	native_color(color, pix);
+	for (int i=0; i<(rs->burst * TFT_PIXEL_BYTES); i++) pat_bytes[i] = pix[i % TFT_PIXEL_BYTES];
+}
+
+// Send the run (x1,y),(x2,y) with the session's color, display must be selected
+// CASET and PASET are only sent when the run's columns or row change
+//------------------------------------------------------------------------------------
+static void IRAM_ATTR _send_run(run_session_t *rs, int16_t x1, int16_t x2, int16_t y)
+{
+	int len, chunk;
+
+	taskDISABLE_INTERRUPTS();
+	if ((x1 != rs->wx1) || (x2 != rs->wx2) || (y != rs->wy)) SPI_COST(windows, 1);
+	if ((x1 != rs->wx1) || (x2 != rs->wx2)) {
+		_send_range(TFT_CASET, x1, x2);
+		rs->wx1 = x1;
+		rs->wx2 = x2;
+	}
+	if (y != rs->wy) {
+		_send_range(TFT_PASET, y, y);
+		rs->wy = y;
+	}
+
+	// Send RAM WRITE command
+	gpio_set_level(PIN_NUM_DC, 0);
+	disp_spi->host->hw->data_buf[0] = (uint32_t)TFT_RAMWR;
+	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = 7;
+	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
+	while (disp_spi->host->hw->cmd.usr);	// Wait for SPI bus ready
+	SPI_COST(commands, 1);
+	SPI_COST(transactions, 1);
+
+	// Set DC to 1 (data mode);
+	gpio_set_level(PIN_NUM_DC, 1);
+	len = x2 - x1 + 1;
+	while (len > 0) {
+		chunk = ((len > rs->burst) ? rs->burst : len);
+		for (int i=0; i<((chunk * TFT_PIXEL_BYTES + 3) / 4); i++) disp_spi->host->hw->data_buf[i] = rs->pat[i];
+		disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = (chunk * TFT_PIXEL_BYTES * 8) - 1;
+		disp_spi->host->hw->cmd.usr = 1;		// Start transfer
+		while (disp_spi->host->hw->cmd.usr);	// Wait for SPI bus ready
+		SPI_COST(data_bytes, chunk * TFT_PIXEL_BYTES);
+		SPI_COST(transactions, 1);
+		len -= chunk;
+	}
+	taskENABLE_INTERRUPTS();
+}
+
+// Draw many pixels of the same color in one selected session
+// Points are sorted in place and adjacent pixels on a row are sent as one run
+//-------------------------------------------------------------
+void drawPixels(tft_point_t *points, int count, color_t color)
+{
+	run_session_t rs;
+	int n = 0;
+	int16_t x1, x2, y;
+
+	if (count <= 0) return;
+	if (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX)) return;
+
+	qsort(points, count, sizeof(tft_point_t), _point_cmp);
+
+	if (_shadow_fb) {
+		while (n < count) {
+			x1 = points[n].x;
+			y = points[n].y;
+			n = _point_run(points, count, n, &x2);
+			_shadow_window(x1, y, x2, y);
+			_shadow_put_colors(&color, x2 - x1 + 1, 1);
+		}
+		return;
+	}
+
+	_run_begin(&rs, color);
+	if (disp_select() != ESP_OK) return;
+
+	while (n < count) {
+		x1 = points[n].x;
+		y = points[n].y;
+		n = _point_run(points, count, n, &x2);
+		_send_run(&rs, x1, x2, y);
+	}
+
+	disp_deselect();
+}
+
+// Draw horizontal spans of the same color in one selected session
+// Spans must be within the display, they are sent in the given order
+//-----------------------------------------------------------
+void drawSpans(tft_span_t *spans, int count, color_t color)
+{
+	run_session_t rs;
+
+	if (count <= 0) return;
+	if (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX)) return;
+
+	if (_shadow_fb) {
+		for (int n=0; n<count; n++) {
+			_shadow_window(spans[n].x, spans[n].y, spans[n].x + spans[n].w - 1, spans[n].y);
+			_shadow_put_colors(&color, spans[n].w, 1);
+		}
+		return;
+	}
+
+	_run_begin(&rs, color);
+	if (disp_select() != ESP_OK) return;
+
+	for (int n=0; n<count; n++) {
+		if (spans[n].w > 0) _send_run(&rs, spans[n].x, spans[n].x + spans[n].w - 1, spans[n].y);
+	}
+
+	disp_deselect();
+}
+
 //-----------------------------------------------------------
 static void IRAM_ATTR _dma_send(uint8_t *data, uint32_t size)
 {
@@ -295,6 +737,23 @@ static void IRAM_ATTR _dma_send(uint8_t *data, uint32_t size)
 	_dma_sending = 1;
 	// Start transfer
 	disp_spi->host->hw->cmd.usr = 1;
+	SPI_COST(data_bytes, size);
+	SPI_COST(transactions, 1);
+}
+
+//-----------------------------------------------------------------------------------
+static void IRAM_ATTR _dma_stream(uint8_t *data, uint32_t size)
+{
+	// Stream the whole buffer under a single RAMWR,
+	// each chunk is sent through the host's chained DMA descriptors
+	uint32_t chunk;
+	while (size > 0) {
+		chunk = ((size > disp_spi->host->max_transfer_sz) ? disp_spi->host->max_transfer_sz : size);
+		wait_trans_finish(0);
+		_dma_send(data, chunk);
+		data += chunk;
+		size -= chunk;
+	}
 }
 
 //---------------------------------------------------------------------------
@@ -305,53 +764,135 @@ static void IRAM_ATTR _direct_send(color_t *color, uint32_t len, uint8_t rep)
 	int idx = 0;
 	int bits = 0;
 	int wbits = 0;
+	uint8_t pix[TFT_PIXEL_BYTES];
 
     taskDISABLE_INTERRUPTS();
 	color_t _color = color[0];
 	if ((rep) && (gray_scale)) _color = color2gs(color[0]);
+	if (rep) color2native(_color, pix);
 
 	while (len) {
 		// ** Get color data from color buffer **
 		if (rep == 0) {
 			if (gray_scale) _color = color2gs(color[cidx]);
 			else _color = color[cidx];
+			color2native(_color, pix);
 		}
 
-		wd |= (uint32_t)_color.r << wbits;
-		wbits += 8;
-		if (wbits == 32) {
-			bits += wbits;
-			wbits = 0;
-			disp_spi->host->hw->data_buf[idx++] = wd;
-			wd = 0;
-		}
-		wd |= (uint32_t)_color.g << wbits;
-		wbits += 8;
-		if (wbits == 32) {
-			bits += wbits;
-			wbits = 0;
-			disp_spi->host->hw->data_buf[idx++] = wd;
-			wd = 0;
-		}
-		wd |= (uint32_t)_color.b << wbits;
-		wbits += 8;
-		if (wbits == 32) {
-			bits += wbits;
-			wbits = 0;
-			disp_spi->host->hw->data_buf[idx++] = wd;
-			wd = 0;
+		for (int n=0; n<TFT_PIXEL_BYTES; n++) {
+			wd |= (uint32_t)pix[n] << wbits;
+			wbits += 8;
+			if (wbits == 32) {
+				bits += wbits;
+				wbits = 0;
+				disp_spi->host->hw->data_buf[idx++] = wd;
+				wd = 0;
+			}
 		}
     	len--;					// Decrement colors counter
         if (rep == 0) cidx++;	// if not repeating color, increment color buffer index
     }
+	if (wbits) {
+		// last partial word
+		bits += wbits;
+		disp_spi->host->hw->data_buf[idx] = wd;
+	}
 	if (bits) {
 		while (disp_spi->host->hw->cmd.usr);						// Wait for SPI bus ready
 		disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = bits-1;	// set number of bits to be sent
         disp_spi->host->hw->cmd.usr = 1;							// Start transfer
+		SPI_COST(data_bytes, bits/8);
+		SPI_COST(transactions, 1);
 	}
     taskENABLE_INTERRUPTS();
 }
 
+// Pixels fitting into spi data buffer
+#define DIRECT_PIXELS	(64 / TFT_PIXEL_BYTES)
+
+// Get a line filled with color 'pix' (display's pixel format) from the fill line cache
+// Returns NULL if the line can't be allocated
+//-----------------------------------------------
+static uint8_t * IRAM_ATTR _fill_line(uint8_t *pix)
+{
+	fill_line_t *line = &fill_cache[0];
+	uint32_t done, count;
+
+	fill_stamp++;
+	for (int n=0; n<FILL_CACHE_LINES; n++) {
+		if ((fill_cache[n].buf) && (memcmp(fill_cache[n].pix, pix, TFT_PIXEL_BYTES) == 0)) {
+			fill_cache[n].used = fill_stamp;
+			return fill_cache[n].buf;
+		}
+		if (fill_cache[n].used < line->used) line = &fill_cache[n];
+	}
+
+	// Replace the least recently used line
+	if (line->buf == NULL) {
+		line->buf = heap_caps_malloc(FILL_LINE_PIXELS * TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
+		if (line->buf == NULL) return NULL;
+	}
+	else wait_trans_finish(0);	// the line may still be being sent
+
+	memcpy(line->pix, pix, TFT_PIXEL_BYTES);
+	memcpy(line->buf, pix, TFT_PIXEL_BYTES);
+	done = TFT_PIXEL_BYTES;
+	while (done < (FILL_LINE_PIXELS * TFT_PIXEL_BYTES)) {
+		count = (FILL_LINE_PIXELS * TFT_PIXEL_BYTES) - done;
+		if (count > done) count = done;
+		memcpy(line->buf + done, line->buf, count);
+		done += count;
+	}
+	line->used = fill_stamp;
+	return line->buf;
+}
+
+// Convert color buffer to the display's pixel format (gray scale if set) and send it using DMA
+// Conversion of the next block overlaps with sending of the previous one,
+// the caller's buffer is left unchanged
+//---------------------------------------------------------------
+static void IRAM_ATTR _convert_send(color_t *color, uint32_t len)
+{
+	if (conv_buf == NULL) {
+		conv_buf = heap_caps_malloc(CONV_BUF_PIXELS*2*TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
+		if (conv_buf == NULL) return;
+	}
+
+	uint8_t *buf;
+	uint32_t n;
+	uint8_t blk = 0;
+	uint64_t start;
+	while (len > 0) {
+		n = ((len > CONV_BUF_PIXELS) ? CONV_BUF_PIXELS : len);
+		buf = conv_buf + (blk * CONV_BUF_PIXELS * TFT_PIXEL_BYTES);
+		start = esp_timer_get_time();
+		for (uint32_t i=0; i<n; i++) {
+			color2native((gray_scale) ? color2gs(color[i]) : color[i], buf + (i*TFT_PIXEL_BYTES));
+		}
+		conv_us += (uint32_t)(esp_timer_get_time() - start);
+		wait_trans_finish(0);
+		_dma_send(buf, n*TFT_PIXEL_BYTES);
+		color += n;
+		len -= n;
+		blk ^= 1;
+	}
+}
+
+//------------------------------------
+static void IRAM_ATTR _send_ramwr()
+{
+	// Send RAM WRITE command
+    gpio_set_level(PIN_NUM_DC, 0);
+    disp_spi->host->hw->data_buf[0] = (uint32_t)TFT_RAMWR;
+	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = 7;
+	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
+	while (disp_spi->host->hw->cmd.usr);	// Wait for SPI bus ready
+	SPI_COST(commands, 1);
+	SPI_COST(transactions, 1);
+
+	gpio_set_level(PIN_NUM_DC, 1);			// Set DC to 1 (data mode);
+}
+
 // ================================================================
 // === Main function to send data to display ======================
 // If  rep==true:  repeat sending color data to display 'len' times
@@ -364,69 +905,50 @@ static void IRAM_ATTR _TFT_pushColorRep(color_t *color, uint32_t len, uint8_t re
 	if (len == 0) return;
 	if (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX)) return;
 
-	// Send RAM WRITE command
-    gpio_set_level(PIN_NUM_DC, 0);
-    disp_spi->host->hw->data_buf[0] = (uint32_t)TFT_RAMWR;
-	disp_spi->host->hw->mosi_dlen.usr_mosi_dbitlen = 7;
-	disp_spi->host->hw->cmd.usr = 1;		// Start transfer
-	while (disp_spi->host->hw->cmd.usr);	// Wait for SPI bus ready
-
-	gpio_set_level(PIN_NUM_DC, 1);								// Set DC to 1 (data mode);
+	_send_ramwr();
 
-	if ((len*24) <= 512) {
+	if ((len*TFT_PIXEL_BYTES*8) <= 512) {
 
 		_direct_send(color, len, rep);
 
 	}
 	else if (rep == 0)  {
 		// ==== use DMA transfer ====
-		// ** Prepare data
-		if (gray_scale) {
-			for (int n=0; n<len; n++) {
-				color[n] = color2gs(color[n]);
-			}
-	    }
-
-	    _dma_send((uint8_t *)color, len*3);
+#if TFT_COLOR_BITS == 16
+		_convert_send(color, len);
+#else
+		// color_t is the native format, only gray scale needs converting
+		if (gray_scale) _convert_send(color, len);
+		else _dma_stream((uint8_t *)color, len*3);
+#endif
 	}
 	else {
 		// ==== Repeat color, more than 512 bits total ====
 
-		color_t _color;
-		uint32_t buf_colors;
-		int buf_bytes, to_send;
+		uint8_t pix[TFT_PIXEL_BYTES];
+		uint8_t *line = NULL;
+		int to_send;
 
-		/*
-		to_send = len;
-		while (to_send > 0) {
-			wait_trans_finish(0);
-			_direct_send(color, ((to_send > 21) ? 21 : to_send), rep);
-			to_send -= 21;
-		}
-		*/
+		native_color(color[0], pix);
+		if ((len*TFT_PIXEL_BYTES) > FILL_DIRECT_BYTES) line = _fill_line(pix);
 
-		buf_colors = ((len > (_width*2)) ? (_width*2) : len);
-		buf_bytes = buf_colors * 3;
-
-		// Prepare color buffer of maximum 2 color lines
-		trans_cline = heap_caps_malloc(buf_bytes, MALLOC_CAP_DMA);
-		if (trans_cline == NULL) return;
-
-		// Prepare fill color
-		if (gray_scale) _color = color2gs(color[0]);
-		else _color = color[0];
-
-		// Fill color buffer with fill color
-		for (uint32_t i=0; i<buf_colors; i++) {
-			trans_cline[i] = _color;
+		if (line == NULL) {
+			// Small fill, send it in data buffer sized blocks
+			to_send = len;
+			while (to_send > 0) {
+				while (disp_spi->host->hw->cmd.usr);
+				_direct_send(color, ((to_send > DIRECT_PIXELS) ? DIRECT_PIXELS : to_send), rep);
+				to_send -= DIRECT_PIXELS;
+			}
 		}
-
-		// Send 'len' colors
-		to_send = len;
-		while (to_send > 0) {
-			wait_trans_finish(0);
-			_dma_send((uint8_t *)trans_cline, ((to_send > buf_colors) ? buf_bytes : (to_send*3)));
-			to_send -= buf_colors;
+		else {
+			// Send 'len' colors
+			to_send = len;
+			while (to_send > 0) {
+				wait_trans_finish(0);
+				_dma_send(line, ((to_send > FILL_LINE_PIXELS) ? FILL_LINE_PIXELS : to_send) * TFT_PIXEL_BYTES);
+				to_send -= FILL_LINE_PIXELS;
+			}
 		}
 	}
 
@@ -437,6 +959,12 @@ static void IRAM_ATTR _TFT_pushColorRep(color_t *color, uint32_t len, uint8_t re
 //-------------------------------------------------------------------------------------------
 void IRAM_ATTR TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
 {
+	if (_shadow_fb) {
+		_shadow_window(x1, y1, x2, y2);
+		_shadow_put_colors(&color, len, 1);
+		return;
+	}
+
 	if (disp_select() != ESP_OK) return;
 
 	// ** Send address window **
@@ -449,6 +977,12 @@ void IRAM_ATTR TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t color, u
 
 void IRAM_ATTR TFT_pushColorRepBuffer(int x1, int y1, int x2, int y2, color_t * color, uint32_t len)
 {
+	if (_shadow_fb) {
+		_shadow_window(x1, y1, x2, y2);
+		_shadow_put_colors(color, len, 0);
+		return;
+	}
+
 	if (disp_select() != ESP_OK) return;
 
 	// ** Send address window **
@@ -464,11 +998,528 @@ void IRAM_ATTR TFT_pushColorRepBuffer(int x1, int y1, int x2, int y2, color_t *
 //-----------------------------------------------------------------------------------
 void IRAM_ATTR send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf)
 {
+	if (_shadow_fb) {
+		_shadow_window(x1, y1, x2, y2);
+		_shadow_put_colors(buf, len, 0);
+		return;
+	}
+
 	// ** Send address window **
 	disp_spi_transfer_addrwin(x1, x2, y1, y2);
 	_TFT_pushColorRep(buf, len, 0, 0);
 }
 
+// Send 'size' bytes of data already in display's pixel format (TFT_PIXEL_BYTES per pixel)
+// No color conversion is done, 'gray_scale' is ignored
+// ** Device must already be selected and address window set **
+//---------------------------------------------------------------------------
+static void IRAM_ATTR _TFT_pushRaw(uint8_t *buf, uint32_t size, uint8_t wait)
+{
+	if (size == 0) return;
+	if (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX)) return;
+
+	_send_ramwr();
+	_dma_stream(buf, size);
+
+	if (wait) wait_trans_finish(1);
+}
+
+// Write 'size' bytes of raw pixel data to TFT 'window' (x1,y2),(x2,y2) from given buffer
+// 'buf' must be DMA capable
+//-------------------------------------------------------------------------------------------
+void IRAM_ATTR TFT_pushRawBuffer(int x1, int y1, int x2, int y2, uint8_t *buf, uint32_t size)
+{
+	if (_shadow_fb) {
+		_shadow_window(x1, y1, x2, y2);
+		_shadow_put(buf, size / TFT_PIXEL_BYTES, 0);
+		return;
+	}
+
+	if (disp_select() != ESP_OK) return;
+
+	// ** Send address window **
+	disp_spi_transfer_addrwin(x1, x2, y1, y2);
+
+	_TFT_pushRaw(buf, size, 1);
+
+	disp_deselect();
+}
+
+// Write 'size' bytes of raw pixel data to TFT 'window' (x1,y2),(x2,y2) from given buffer
+// ** Device must already be selected **
+//----------------------------------------------------------------------------------------
+void IRAM_ATTR send_raw_data(int x1, int y1, int x2, int y2, uint32_t size, uint8_t *buf)
+{
+	if (_shadow_fb) {
+		_shadow_window(x1, y1, x2, y2);
+		_shadow_put(buf, size / TFT_PIXEL_BYTES, 0);
+		return;
+	}
+
+	// ** Send address window **
+	disp_spi_transfer_addrwin(x1, x2, y1, y2);
+	_TFT_pushRaw(buf, size, 0);
+}
+
+// Write the window (x1,y1),(x2,y2) with rows generated by 'fill', in one RAMWR
+// Rows are generated into one DMA buffer while the previous ones are being sent
+// With the shadow framebuffer enabled the rows are written to it
+//------------------------------------------------------------------------------------------
+void TFT_pushRows(int x1, int y1, int x2, int y2, tft_rows_cb_t fill, void *arg)
+{
+	TFT_pushBands(x1, y1, x2, y2, 0, fill, arg);
+}
+
+// As TFT_pushRows(), 'fill' being called for at most 'band_rows' rows at a time
+// (0 or more than fit in the DMA buffer: as many as fit)
+//---------------------------------------------------------------------------------------------------------
+void IRAM_ATTR TFT_pushBands(int x1, int y1, int x2, int y2, int band_rows, tft_rows_cb_t fill, void *arg)
+{
+	uint32_t row_bytes = (x2 - x1 + 1) * TFT_PIXEL_BYTES;
+	int rows_per = ROWS_BUF_BYTES / row_bytes;
+	int rows;
+	uint8_t *buf;
+	uint8_t blk = 0;
+
+	if ((band_rows > 0) && (band_rows < rows_per)) rows_per = band_rows;
+	if ((rows_per == 0) || (x1 > x2) || (y1 > y2)) return;
+	if (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX)) return;
+
+	if (rows_buf == NULL) {
+		rows_buf = heap_caps_malloc(ROWS_BUF_BYTES*2, MALLOC_CAP_DMA);
+		if (rows_buf == NULL) return;
+	}
+
+	if (_shadow_fb) {
+		_shadow_window(x1, y1, x2, y2);
+		for (int y=y1; y<=y2; y+=rows) {
+			rows = (((y2 - y + 1) > rows_per) ? rows_per : (y2 - y + 1));
+			fill(rows_buf, y, rows, arg);
+			_shadow_put(rows_buf, rows * (x2 - x1 + 1), 0);
+		}
+		return;
+	}
+
+	if (disp_select() != ESP_OK) return;
+
+	// ** Send address window **
+	disp_spi_transfer_addrwin(x1, x2, y1, y2);
+	_send_ramwr();
+
+	for (int y=y1; y<=y2; y+=rows) {
+		rows = (((y2 - y + 1) > rows_per) ? rows_per : (y2 - y + 1));
+		buf = rows_buf + (blk * ROWS_BUF_BYTES);
+		fill(buf, y, rows, arg);
+		_dma_stream(buf, rows * row_bytes);
+		blk ^= 1;
+	}
+	wait_trans_finish(1);
+
+	disp_deselect();
+}
+
+// ==== Async transfers ==========================================
+
+// Set DC before each queued transaction, called from the spi interrupt
+//-----------------------------------------------------------------------
+static void IRAM_ATTR _queue_pre_cb(spi_lobo_transaction_t *trans)
+{
+	gpio_set_level(PIN_NUM_DC, (uint32_t)trans->user & 1);
+}
+
+// Complete the block when its last transaction is sent, called from the spi interrupt
+//------------------------------------------------------------------------
+static void IRAM_ATTR _queue_post_cb(spi_lobo_transaction_t *trans)
+{
+	BaseType_t woken = pdFALSE;
+
+	if (trans->user != TFT_QUEUE_END) return;
+
+	tft_async_block_t *blk = &_async_blocks[_async_blk_tail];
+	_async_blk_tail = (_async_blk_tail + 1) % TFT_QUEUE_DEPTH;
+	_async_done = blk->handle;
+	if (blk->cb) blk->cb(blk->handle, blk->arg);
+	if (_async_waiter) vTaskNotifyGiveFromISR(_async_waiter, &woken);
+	if (woken) portYIELD_FROM_ISR();
+}
+
+//-------------------------------------------------------------------------------------------
+static esp_err_t IRAM_ATTR _queue_cmd_data(uint8_t cmd, uint16_t d1, uint16_t d2)
+{
+	spi_lobo_transaction_t t;
+	esp_err_t ret;
+
+	memset(&t, 0, sizeof(t));
+	t.flags = LB_SPI_TRANS_USE_TXDATA;
+	t.length = 8;
+	t.tx_data[0] = cmd;
+	t.user = TFT_QUEUE_CMD;
+	ret = spi_lobo_queue_trans(disp_spi, &t, portMAX_DELAY);
+	if (ret != ESP_OK) return ret;
+	SPI_COST(commands, 1);
+	SPI_COST(transactions, 1);
+	if (cmd == TFT_RAMWR) return ret;
+
+	t.length = 32;
+	t.tx_data[0] = d1 >> 8;
+	t.tx_data[1] = d1 & 0xFF;
+	t.tx_data[2] = d2 >> 8;
+	t.tx_data[3] = d2 & 0xFF;
+	t.user = TFT_QUEUE_DATA;
+	ret = spi_lobo_queue_trans(disp_spi, &t, portMAX_DELAY);
+	if (ret != ESP_OK) return ret;
+	SPI_COST(data_bytes, 4);
+	SPI_COST(transactions, 1);
+	return ret;
+}
+
+//---------------------------------------------
+bool IRAM_ATTR async_done(tft_async_t handle)
+{
+	return ((int32_t)(_async_done - handle) >= 0);
+}
+
+//-------------------------------------------------------------------
+esp_err_t IRAM_ATTR wait_async(tft_async_t handle, TickType_t timeout)
+{
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+
+	_async_waiter = xTaskGetCurrentTaskHandle();
+	while (!async_done(handle)) {
+		elapsed = xTaskGetTickCount() - start;
+		if ((timeout != portMAX_DELAY) && (elapsed >= timeout)) {
+			_async_waiter = NULL;
+			return ESP_ERR_TIMEOUT;
+		}
+		ulTaskNotifyTake(pdTRUE, (timeout == portMAX_DELAY) ? portMAX_DELAY : (timeout - elapsed));
+	}
+	_async_waiter = NULL;
+	return ESP_OK;
+}
+
+// Queue 'size' bytes of raw pixel data for TFT 'window' (x1,y2),(x2,y2) and return without
+// waiting; blocks are sent back to back by the spi interrupt while the caller prepares the next one
+// The display is selected if needed and stays selected until deselected
+// 'cb' (if not NULL) is called from the interrupt when the data are sent
+// 'buf' must be DMA capable and must not be changed until the transfer completes
+// Returns the transfer handle or 0 if the data were sent synchronously or could not be sent
+//---------------------------------------------------------------------------------------------------------------------------------
+tft_async_t IRAM_ATTR send_raw_async(int x1, int y1, int x2, int y2, uint32_t size, uint8_t *buf, tft_async_cb_t cb, void *arg)
+{
+	if ((size == 0) || (!(disp_spi->cfg.flags & LB_SPI_DEVICE_HALFDUPLEX))) return 0;
+
+	if ((!_queue_ok) || (_shadow_fb)) {
+		// no transaction queue or drawing to the shadow, send synchronously
+		TFT_pushRawBuffer(x1, y1, x2, y2, buf, size);
+		if (cb) cb(0, arg);
+		return 0;
+	}
+
+	if (!disp_spi->cfg.selected) {
+		if (disp_select() != ESP_OK) return 0;
+	}
+	else if (spi_lobo_queue_idle(disp_spi)) {
+		// finish any direct transfer before the queue takes over the bus
+		wait_trans_finish(0);
+	}
+
+	if (++_async_last == 0) _async_last = 1;	// 0 is never a valid handle
+	tft_async_t handle = _async_last;
+	uint8_t *data = buf;
+	uint32_t total = size;
+
+	if (_queue_cmd_data(TFT_CASET, x1, x2) != ESP_OK) goto fail;
+	if (_queue_cmd_data(TFT_PASET, y1, y2) != ESP_OK) goto fail;
+	SPI_COST(windows, 1);
+	if (_queue_cmd_data(TFT_RAMWR, 0, 0) != ESP_OK) goto fail;
+
+	spi_lobo_transaction_t t;
+	memset(&t, 0, sizeof(t));
+	t.user = TFT_QUEUE_DATA;
+	while (size > 0) {
+		uint32_t chunk = ((size > disp_spi->host->max_transfer_sz) ? disp_spi->host->max_transfer_sz : size);
+		size -= chunk;
+		if (size == 0) {
+			// the block is registered before its last transaction can complete
+			tft_async_block_t *blk = &_async_blocks[_async_blk_head];
+			blk->handle = handle;
+			blk->cb = cb;
+			blk->arg = arg;
+			_async_blk_head = (_async_blk_head + 1) % TFT_QUEUE_DEPTH;
+			t.user = TFT_QUEUE_END;
+		}
+		t.length = chunk * 8;
+		t.tx_buffer = buf;
+		if (spi_lobo_queue_trans(disp_spi, &t, portMAX_DELAY) != ESP_OK) {
+			// drop the block registered for the last transaction
+			if (size == 0) _async_blk_head = (_async_blk_head + TFT_QUEUE_DEPTH - 1) % TFT_QUEUE_DEPTH;
+			goto fail;
+		}
+		SPI_COST(data_bytes, chunk);
+		SPI_COST(transactions, 1);
+		buf += chunk;
+	}
+
+	return handle;
+
+fail:
+	// let the queued part finish, then send the whole block synchronously
+	disp_deselect();
+	TFT_pushRawBuffer(x1, y1, x2, y2, data, total);
+	if (cb) cb(0, arg);
+	return 0;
+}
+
+// ==== Shadow framebuffer ========================================
+
+// Send the shadow's rectangle to the display, display must be selected
+//-------------------------------------------------------------------
+static void _shadow_send(int x1, int y1, int x2, int y2)
+{
+	uint32_t row_bytes = (x2 - x1 + 1) * TFT_PIXEL_BYTES;
+	uint32_t rows = 0;
+	uint8_t *buf;
+	uint8_t blk = 0;
+
+	wait_trans_finish(0);
+	disp_spi_transfer_addrwin(x1, x2, y1, y2);
+	_send_ramwr();
+
+	if (x2 - x1 + 1 == _shadow_w) {
+		// full width rows are contiguous in the shadow, send them as they are
+		_dma_stream(_shadow_fb + (y1 * row_bytes), row_bytes * (y2 - y1 + 1));
+		return;
+	}
+
+	// Gather the rows into one staging block while the other one is being sent
+	while (y1 <= y2) {
+		rows = SHADOW_STAGE_BYTES / row_bytes;
+		if (rows > (y2 - y1 + 1)) rows = y2 - y1 + 1;
+		buf = _shadow_stage + (blk * SHADOW_STAGE_BYTES);
+		for (uint32_t i=0; i<rows; i++) {
+			memcpy(buf + (i * row_bytes), _shadow_fb + ((((y1+i) * _shadow_w) + x1) * TFT_PIXEL_BYTES), row_bytes);
+		}
+		_dma_stream(buf, rows * row_bytes);
+		y1 += rows;
+		blk ^= 1;
+	}
+}
+
+//=================
+void shadow_flush()
+{
+	uint32_t dirty;
+	int r, r2, c1, c2;
+
+	if (_shadow_fb == NULL) return;
+	if (disp_select() != ESP_OK) return;
+
+	r = 0;
+	while (r < _shadow_rows) {
+		dirty = _shadow_dirty[r];
+		if (dirty == 0) {
+			r++;
+			continue;
+		}
+		// One rectangle spans from the first to the last changed tile in the row,
+		// the following rows are merged into it while they span the same tiles
+		c1 = __builtin_ctz(dirty);
+		c2 = 31 - __builtin_clz(dirty);
+		r2 = r;
+		while ((r2+1 < _shadow_rows) && (_shadow_dirty[r2+1] != 0) &&
+				(__builtin_ctz(_shadow_dirty[r2+1]) == c1) && ((31 - __builtin_clz(_shadow_dirty[r2+1])) == c2)) r2++;
+
+		_shadow_send(c1 * TFT_SHADOW_TILE, r * TFT_SHADOW_TILE,
+				(((c2+1) * TFT_SHADOW_TILE > _shadow_w) ? _shadow_w : ((c2+1) * TFT_SHADOW_TILE)) - 1,
+				(((r2+1) * TFT_SHADOW_TILE > _shadow_h) ? _shadow_h : ((r2+1) * TFT_SHADOW_TILE)) - 1);
+
+		while (r <= r2) _shadow_dirty[r++] = 0;
+	}
+
+	disp_deselect();
+}
+
+//-------------------------
+static void _shadow_free()
+{
+	if (_shadow_fb) heap_caps_free(_shadow_fb);
+	if (_shadow_stage) heap_caps_free(_shadow_stage);
+	if (_shadow_dirty) free(_shadow_dirty);
+	_shadow_fb = NULL;
+	_shadow_stage = NULL;
+	_shadow_dirty = NULL;
+}
+
+//========================================
+esp_err_t shadow_enable(uint8_t enable)
+{
+	int rows;
+
+	if (!enable) {
+		shadow_flush();
+		_shadow_free();
+		return ESP_OK;
+	}
+
+	if (((_width + TFT_SHADOW_TILE - 1) / TFT_SHADOW_TILE) > SHADOW_MAX_COLS) return ESP_ERR_NOT_SUPPORTED;
+	if ((_width * TFT_PIXEL_BYTES) > SHADOW_STAGE_BYTES) return ESP_ERR_NOT_SUPPORTED;
+
+	if ((_shadow_fb == NULL) || ((_shadow_w * _shadow_h) != (_width * _height))) {
+		_shadow_free();
+		// dirty map sized for either orientation, rotating only swaps the dimensions
+		rows = (((_width > _height) ? _width : _height) + TFT_SHADOW_TILE - 1) / TFT_SHADOW_TILE;
+		_shadow_fb = heap_caps_malloc(_width * _height * TFT_PIXEL_BYTES, MALLOC_CAP_DMA);
+		_shadow_stage = heap_caps_malloc(SHADOW_STAGE_BYTES * 2, MALLOC_CAP_DMA);
+		_shadow_dirty = calloc(rows, sizeof(uint32_t));
+		if ((_shadow_fb == NULL) || (_shadow_stage == NULL) || (_shadow_dirty == NULL)) {
+			_shadow_free();
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	else if ((_shadow_w == _width) && (_shadow_h == _height)) return ESP_OK;
+
+	// New shadow (or new orientation) starts black and all changed,
+	// so the next flush makes the display match it
+	_shadow_w = _width;
+	_shadow_h = _height;
+	_shadow_rows = (_height + TFT_SHADOW_TILE - 1) / TFT_SHADOW_TILE;
+	memset(_shadow_fb, 0, _width * _height * TFT_PIXEL_BYTES);
+	_shadow_window(0, 0, _width-1, _height-1);
+	_shadow_mark(0, 0, _width-1, _height-1);
+	return ESP_OK;
+}
+
+//=============================================================
+int shadow_read_raw(int x1, int y1, int x2, int y2, uint8_t *buf)
+{
+	uint32_t row_bytes = (x2 - x1 + 1) * TFT_PIXEL_BYTES;
+
+	if (_shadow_fb == NULL) return -1;
+	if ((x1 < 0) || (y1 < 0) || (x1 > x2) || (y1 > y2) || (x2 >= _shadow_w) || (y2 >= _shadow_h)) return -1;
+
+	for (int y=y1; y<=y2; y++) {
+		memcpy(buf, _shadow_fb + (((y * _shadow_w) + x1) * TFT_PIXEL_BYTES), row_bytes);
+		buf += row_bytes;
+	}
+	return 0;
+}
+
+//======================
+uint8_t shadow_active()
+{
+	return (_shadow_fb != NULL);
+}
+
+//=============================================
+void TFT_getSpiCost(tft_spi_cost_t *cost)
+{
+#if TFT_SPI_COST
+	memcpy(cost, &_spi_cost, sizeof(tft_spi_cost_t));
+#else
+	memset(cost, 0, sizeof(tft_spi_cost_t));
+#endif
+}
+
+//===================
+void TFT_resetSpiCost()
+{
+#if TFT_SPI_COST
+	memset(&_spi_cost, 0, sizeof(tft_spi_cost_t));
+#endif
+}
+
+// ==== DMA buffer pool ====================================================
+// Buffers used only during one drawing call are leased from a pool allocated once,
+// so drawing does not fragment DMA capable memory over time
+
+//-------------------------
+static void _pool_init()
+{
+	if (pool_mem) return;
+
+	pool_mem = heap_caps_malloc(TFT_POOL_BLOCK * TFT_POOL_BLOCKS, MALLOC_CAP_DMA);
+	if (pool_mem == NULL) return;
+	pool_map = 0;
+	memset(&pool_stats, 0, sizeof(tft_pool_stats_t));
+	pool_stats.blocks = TFT_POOL_BLOCKS;
+}
+
+//=======================================================
+uint8_t *TFT_bufLease(tft_buf_type_t type, uint32_t size)
+{
+	uint32_t n = (size + TFT_POOL_BLOCK - 1) / TFT_POOL_BLOCK;
+	uint32_t mask, blk;
+	uint8_t *buf = NULL;
+
+	if ((pool_mem) && (n > 0) && (n <= TFT_POOL_BLOCKS)) {
+		mask = (n == 32) ? 0xFFFFFFFF : ((1UL << n) - 1);
+		portENTER_CRITICAL(&pool_mux);
+		// first run of 'n' free blocks
+		for (blk=0; blk<=(TFT_POOL_BLOCKS - n); blk++) {
+			if ((pool_map & (mask << blk)) == 0) {
+				pool_map |= mask << blk;
+				pool_len[blk] = n;
+				pool_type[blk] = type;
+				pool_stats.used += n;
+				pool_stats.type_used[type] += n;
+				pool_stats.leases++;
+				if (pool_stats.used > pool_stats.high_water) pool_stats.high_water = pool_stats.used;
+				buf = pool_mem + (blk * TFT_POOL_BLOCK);
+				break;
+			}
+		}
+		portEXIT_CRITICAL(&pool_mux);
+		if (buf) return buf;
+	}
+
+	buf = heap_caps_malloc(size, MALLOC_CAP_DMA);
+	if (buf) {
+		portENTER_CRITICAL(&pool_mux);
+		pool_stats.fallbacks++;
+		portEXIT_CRITICAL(&pool_mux);
+	}
+	return buf;
+}
+
+//============================
+void TFT_bufReturn(void *buf)
+{
+	uint8_t *p = (uint8_t *)buf;
+	uint32_t blk, n;
+
+	if (p == NULL) return;
+	if ((pool_mem == NULL) || (p < pool_mem) || (p >= (pool_mem + (TFT_POOL_BLOCK * TFT_POOL_BLOCKS)))) {
+		heap_caps_free(p);
+		return;
+	}
+
+	blk = (p - pool_mem) / TFT_POOL_BLOCK;
+	n = pool_len[blk];
+	portENTER_CRITICAL(&pool_mux);
+	pool_map &= ~(((n == 32) ? 0xFFFFFFFF : ((1UL << n) - 1)) << blk);
+	pool_stats.used -= n;
+	pool_stats.type_used[pool_type[blk]] -= n;
+	portEXIT_CRITICAL(&pool_mux);
+}
+
+//=========================
+uint32_t TFT_takeConvertTime()
+{
+	uint32_t t = conv_us;
+
+	conv_us = 0;
+	return t;
+}
+
+//============================================
+void TFT_getPoolStats(tft_pool_stats_t *stats)
+{
+	portENTER_CRITICAL(&pool_mux);
+	memcpy(stats, &pool_stats, sizeof(tft_pool_stats_t));
+	portEXIT_CRITICAL(&pool_mux);
+}
+
 // Reads 'len' pixels/colors from the TFT's GRAM 'window'
 // 'buf' is an array of bytes with 1st byte reserved for reading 1 dummy byte
 // and the rest is actually an array of color_t values
@@ -481,6 +1532,12 @@ int IRAM_ATTR read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, u
     memset(&t, 0, sizeof(t));  //Zero out the transaction
 	memset(buf, 0, len*sizeof(color_t));
 
+	if (_shadow_fb) {
+		// the display may not be up to date, read from the shadow
+		_shadow_read(x1, y1, x2, y2, len, buf);
+		return ESP_OK;
+	}
+
 	if (set_sp) {
 		if (disp_deselect() != ESP_OK) return -1;
 		// Change spi clock if needed
@@ -675,6 +1732,13 @@ int stmpe610_get_touch(uint16_t *x, uint16_t *y, uint16_t *z)
 // ==== STMPE610 ===========================================================================
 
 
+// Bits of red & blue preserved by the display's pixel format
+#if TFT_COLOR_BITS == 16
+#define RD_MASK_RB	0xF8
+#else
+#define RD_MASK_RB	0xFC
+#endif
+
 // Find maximum spi clock for successful read from display RAM
 // ** Must be used AFTER the display is initialized **
 //======================
@@ -725,9 +1789,9 @@ uint32_t find_rd_speed()
 		line_check = 0;
 		if (ret == ESP_OK) {
 			for (int y=0; y<_width; y++) {
-				if ((color_line[y].r & 0xFC) != (rdline[y].r & 0xFC)) line_check = 1;
+				if ((color_line[y].r & RD_MASK_RB) != (rdline[y].r & RD_MASK_RB)) line_check = 1;
 				else if ((color_line[y].g & 0xFC) != (rdline[y].g & 0xFC)) line_check = 1;
-				else if ((color_line[y].b & 0xFC) != (rdline[y].b & 0xFC)) line_check =  1;
+				else if ((color_line[y].b & RD_MASK_RB) != (rdline[y].b & RD_MASK_RB)) line_check =  1;
 				if (line_check) break;
 			}
 		}
@@ -908,6 +1972,8 @@ void TFT_display_init()
 {
     esp_err_t ret;
 
+    _pool_init();
+
 #if PIN_NUM_RST
     //Reset the display
     gpio_set_level(PIN_NUM_RST, 0);
@@ -948,6 +2014,11 @@ void TFT_display_init()
     ret = disp_deselect();
 	assert(ret==ESP_OK);
 
+	// Transaction queue for async transfers
+	// INVALID_STATE is also returned without a queue (no DMA channel, host interrupt in use)
+	spi_lobo_queue_init(disp_spi, TFT_QUEUE_DEPTH, _queue_pre_cb, _queue_post_cb);
+	_queue_ok = (disp_spi->queue != NULL);
+
 	// Clear screen
     _tft_setRotation(PORTRAIT);
 	TFT_pushColorRep(0, 0, _width-1, _height-1, (color_t){0,0,0}, (uint32_t)(_height*_width));
@@ -39,6 +39,46 @@
 // Configuration for other boards, set the correct values for the display used
 //----------------------------------------------------------------------------
 #define DISP_COLOR_BITS_24	0x66
+#define DISP_COLOR_BITS_16	0x55
+
+// ###########################################################
+// ### Interface pixel format sent to the display:         ###
+// ### 16 -> RGB565, 2 bytes per pixel                     ###
+// ### 24 -> RGB666 (sent as 3 bytes), 3 bytes per pixel   ###
+// ### Drawing functions always take 24-bit color_t values ###
+// ###########################################################
+#define TFT_COLOR_BITS		16
+
+#if TFT_COLOR_BITS == 16
+#define TFT_PIXEL_BYTES		2
+#define DISP_COLOR_BITS		DISP_COLOR_BITS_16
+#define ST7735_COLMOD		0x05	// 16-bit color 5-6-5 color format
+#else
+#define TFT_PIXEL_BYTES		3
+#define DISP_COLOR_BITS		DISP_COLOR_BITS_24
+#define ST7735_COLMOD		0x06	// 18-bit color 6-6-6 color format
+#endif
+
+// ###########################################################
+// ### Set to 1 to count what is sent to the display       ###
+// ### (commands, address windows, bytes, transactions),   ###
+// ### read with TFT_getSpiCost()                          ###
+// ###########################################################
+#define TFT_SPI_COST		1
+
+// ###########################################################
+// ### Tile size in pixels of the shadow framebuffer's     ###
+// ### change tracking, see shadow_enable()                ###
+// ###########################################################
+#define TFT_SHADOW_TILE		16
+
+// ###########################################################
+// ### DMA buffer pool, allocated once in                  ###
+// ### TFT_display_init(), see TFT_bufLease()              ###
+// ### Maximum number of blocks is 32                      ###
+// ###########################################################
+#define TFT_POOL_BLOCK		2048
+#define TFT_POOL_BLOCKS		16
 
 // #############################################
 // ### Set to 1 for some displays,           ###
@@ -93,6 +133,10 @@
 #define DEFAULT_GAMMA_CURVE 0
 #define DEFAULT_SPI_CLOCK   26000000
 #define DEFAULT_DISP_TYPE   DISP_TYPE_ST7735R
+
+#if (TFT_COLOR_BITS == 16) && (DEFAULT_DISP_TYPE == DISP_TYPE_ILI9488)
+#error "ILI9488 does not support 16-bit color over SPI, set TFT_COLOR_BITS to 24"
+#endif
 //----------------------------------------------------------------------------
 
 // ##############################################################
@@ -118,6 +162,54 @@ extern spi_lobo_device_handle_t ts_spi;
 
 // ##############################################################
 
+// Async transfer handle, 0 is never a valid handle
+typedef uint32_t tft_async_t;
+
+// Async transfer completion callback, called from interrupt context
+typedef void (*tft_async_cb_t)(tft_async_t handle, void *arg);
+
+// Fills 'rows' rows of pixels in display's pixel format starting at display row 'y', see TFT_pushRows() and TFT_pushBands()
+typedef void (*tft_rows_cb_t)(uint8_t *buf, int y, int rows, void *arg);
+
+// Display point, see drawPixels()
+typedef struct {
+	int16_t x;
+	int16_t y;
+} tft_point_t;
+
+// Horizontal run of 'w' pixels starting at (x,y), see drawSpans()
+typedef struct {
+	int16_t x;
+	int16_t y;
+	int16_t w;
+} tft_span_t;
+
+// What a pool buffer is leased for, see TFT_bufLease()
+typedef enum {
+	TFT_BUF_GLYPH,		// single character
+	TFT_BUF_BAND,		// string composed in one band
+	TFT_BUF_IMAGE,		// jpeg and bmp line and work buffers
+	TFT_BUF_TYPES
+} tft_buf_type_t;
+
+// DMA buffer pool usage
+typedef struct {
+	uint32_t blocks;					// pool size in blocks, 0 if the pool is not allocated
+	uint32_t used;						// blocks currently leased
+	uint32_t high_water;				// most blocks leased at the same time
+	uint32_t leases;					// buffers leased from the pool
+	uint32_t fallbacks;					// buffers allocated from heap because the pool had no room
+	uint32_t type_used[TFT_BUF_TYPES];	// blocks currently leased per buffer type
+} tft_pool_stats_t;
+
+// Display spi traffic counters, see TFT_SPI_COST
+typedef struct {
+	uint32_t commands;		// command bytes sent (DC low)
+	uint32_t windows;		// address window changes (CASET + PASET)
+	uint32_t data_bytes;	// parameter and pixel bytes sent (DC high)
+	uint32_t transactions;	// spi transactions started
+} tft_spi_cost_t;
+
 // 24-bit color type structure
 typedef struct __attribute__((__packed__)) {
 //typedef struct {
@@ -254,7 +346,7 @@ static const uint8_t ST7789V_init[] = {
   TFT_CMD_GMCTRP1, 14, 0xD0, 0x00, 0x05, 0x0E, 0x15, 0x0D, 0x37, 0x43, 0x47, 0x09, 0x15, 0x12, 0x16, 0x19,
   TFT_CMD_GMCTRN1, 14, 0xD0, 0x00, 0x05, 0x0D, 0x0C, 0x06, 0x2D, 0x44, 0x40, 0x0E, 0x1C, 0x18, 0x16, 0x19,
   TFT_MADCTL, 1, (MADCTL_MX | TFT_RGB_BGR),			// Memory Access Control (orientation)
-  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,            // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit; 0x55 -> 16 bit
+  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS,               // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit; 0x55 -> 16 bit
   TFT_CMD_SLPOUT, TFT_CMD_DELAY, 120,				//  Sleep out,	//  120 ms delay
   TFT_DISPON, TFT_CMD_DELAY, 120,
 };
@@ -283,7 +375,7 @@ static const uint8_t ILI9341_init[] = {
   TFT_MADCTL, 1,									// Memory Access Control (orientation)
   (MADCTL_MX | TFT_RGB_BGR),
   // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit; 0x55 -> 16 bit
-  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,
+  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS,
   TFT_INVOFF, 0,
   TFT_CMD_FRMCTR1, 2, 0x00, 0x18,
   TFT_CMD_DFUNCTR, 4, 0x08, 0x82, 0x27, 0x00,		// Display Function Control
@@ -330,7 +422,7 @@ static const uint8_t ILI9488_init[] = {
 #endif
 
   // *** INTERFACE PIXEL FORMAT: 0x66 -> 18 bit;
-  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,
+  TFT_CMD_PIXFMT, 1, DISP_COLOR_BITS_24,				// ILI9488 supports only 18-bit over SPI
 
   0xB0, 1,   // Interface Mode Control
 	0x00,    // 0x80: SDO NOT USE; 0x00 USE SDO
@@ -379,7 +471,7 @@ static const uint8_t STP7735_init[] = {
   255,			           			//     255 = 500 ms delay
 #endif
   TFT_CMD_PIXFMT, 1+TFT_CMD_DELAY,	//  3: Set color mode, 1 arg + delay:
-  0x06, 							//     18-bit color 6-6-6 color format
+  ST7735_COLMOD, 					//     16 or 18-bit color, see TFT_COLOR_BITS
   10,	          					//     10 ms delay
   ST7735_FRMCTR1, 3+TFT_CMD_DELAY,	//  4: Frame rate control, 3 args + delay:
   0x00,						//     fastest refresh
@@ -473,7 +565,7 @@ static const uint8_t  STP7735R_init[] = {
   TFT_MADCTL , 1      ,		// 14: Memory access control (directions), 1 arg:
   0xC0,						//     row addr/col addr, bottom to top refresh, RGB order
   TFT_CMD_PIXFMT , 1+TFT_CMD_DELAY,	//  15: Set color mode, 1 arg + delay:
-  0x06,								//      18-bit color 6-6-6 color format
+  ST7735_COLMOD,					//      16 or 18-bit color, see TFT_COLOR_BITS
   10						//     10 ms delay
 };
 
@@ -529,13 +621,76 @@ esp_err_t wait_trans_finish(uint8_t free_line);
 void disp_spi_transfer_cmd(int8_t cmd);
 void disp_spi_transfer_cmd_data(int8_t cmd, uint8_t *data, uint32_t len);
 void drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel);
+void drawPixels(tft_point_t *points, int count, color_t color);
+void drawSpans(tft_span_t *spans, int count, color_t color);
 void send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf);
 void TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t data, uint32_t len);
 void TFT_pushColorRepBuffer(int x1, int y1, int x2, int y2, color_t * color, uint32_t len);
+void send_raw_data(int x1, int y1, int x2, int y2, uint32_t size, uint8_t *buf);
+void TFT_pushRows(int x1, int y1, int x2, int y2, tft_rows_cb_t fill, void *arg);
+void TFT_pushBands(int x1, int y1, int x2, int y2, int band_rows, tft_rows_cb_t fill, void *arg);
+void TFT_pushRawBuffer(int x1, int y1, int x2, int y2, uint8_t *buf, uint32_t size);
+tft_async_t send_raw_async(int x1, int y1, int x2, int y2, uint32_t size, uint8_t *buf, tft_async_cb_t cb, void *arg);
+bool async_done(tft_async_t handle);
+esp_err_t wait_async(tft_async_t handle, TickType_t timeout);
 int read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp);
 color_t readPixel(int16_t x, int16_t y);
 int touch_get_data(uint8_t type);
 
+// Convert color to the display's pixel format (TFT_PIXEL_BYTES bytes at 'pix'),
+// converted to gray scale if 'gray_scale' is set
+//==============================================
+void native_color(color_t color, uint8_t *pix);
+
+// Allocate (enable=1) or free (enable=0) the shadow framebuffer
+// While allocated all drawing goes to it and reading is done from it,
+// nothing is sent to the display until shadow_flush()
+// A new shadow starts black, the first flush overwrites the whole display
+// Returns ESP_ERR_NO_MEM if the shadow could not be allocated
+//========================================
+esp_err_t shadow_enable(uint8_t enable);
+
+// Send the shadow framebuffer's changed tiles to the display,
+// merged into as few rectangles as possible
+//=================
+void shadow_flush();
+
+// Copy the shadow framebuffer's rectangle (x1,y1),(x2,y2) in display's pixel format to 'buf'
+// Returns -1 if the shadow framebuffer is not allocated or the rectangle is outside of it
+//=============================================================
+int shadow_read_raw(int x1, int y1, int x2, int y2, uint8_t *buf);
+
+// Returns 1 if the shadow framebuffer is allocated
+//===================
+uint8_t shadow_active();
+
+// Copy the display spi traffic counters to 'cost'
+// All counters are 0 if TFT_SPI_COST is not set
+//============================================
+void TFT_getSpiCost(tft_spi_cost_t *cost);
+
+// Reset the display spi traffic counters
+//===================
+void TFT_resetSpiCost();
+
+// Lease a DMA capable buffer of 'size' bytes from the pool
+// If the pool has no room the buffer is allocated from heap and counted as fallback
+// Returns NULL only if both fail
+//===================================================
+uint8_t *TFT_bufLease(tft_buf_type_t type, uint32_t size);
+
+// Return buffer leased with TFT_bufLease(), NULL is ignored
+//===================================
+void TFT_bufReturn(void *buf);
+
+// Microseconds spent converting colors to the display's pixel format since the last call
+//=========================
+uint32_t TFT_takeConvertTime();
+
+// Copy the DMA buffer pool usage to 'stats'
+//============================================
+void TFT_getPoolStats(tft_pool_stats_t *stats);
+
 
 // Deactivate display's CS line
 //========================
@@ -0,0 +1,61 @@
+/*
+ * Fixed point sine and cosine
+ *
+ * Quarter wave table with one entry per degree,
+ * values in between are linearly interpolated
+ *
+*/
+
+#include "tfttrig.h"
+
+// round(sin(deg) * 32767) for 0 ~ 90 degrees
+// python3 -c "import math; print([round(math.sin(math.radians(d))*32767) for d in range(91)])"
+static const int16_t sin_table[91] = {
+	    0,   572,  1144,  1715,  2286,  2856,  3425,  3993,  4560,  5126,
+	 5690,  6252,  6813,  7371,  7927,  8481,  9032,  9580, 10126, 10668,
+	11207, 11743, 12275, 12803, 13328, 13848, 14364, 14876, 15383, 15886,
+	16383, 16876, 17364, 17846, 18323, 18794, 19260, 19720, 20173, 20621,
+	21062, 21497, 21925, 22347, 22762, 23170, 23571, 23964, 24351, 24730,
+	25101, 25465, 25821, 26169, 26509, 26841, 27165, 27481, 27788, 28087,
+	28377, 28659, 28932, 29196, 29451, 29697, 29934, 30162, 30381, 30591,
+	30791, 30982, 31163, 31335, 31498, 31650, 31794, 31927, 32051, 32165,
+	32269, 32364, 32448, 32523, 32587, 32642, 32687, 32722, 32747, 32762,
+	32767
+};
+
+// 0 and 1.0 (the table ends) must scale display coordinates exactly, so
+// drawing at 0, 90, 180 and 270 degrees matches the unrotated result
+_Static_assert(TRIG_MUL(1, TRIG_ONE) == 1, "TRIG_MUL not exact at 1.0");
+_Static_assert(TRIG_MUL(4095, TRIG_ONE) == 4095, "TRIG_MUL not exact at 1.0");
+_Static_assert(TRIG_MUL(-4095, TRIG_ONE) == -4095, "TRIG_MUL not exact at -1.0");
+_Static_assert(TRIG_MUL(4095, -TRIG_ONE) == -4095, "TRIG_MUL not exact at -1.0");
+_Static_assert(TRIG_MUL(4095, 0) == 0, "TRIG_MUL not exact at 0");
+
+//==============================
+int16_t trig_sin(int32_t angle)
+{
+	int32_t a = angle % TRIG_DEG(360);
+	int32_t v;
+	int16_t deg, frac;
+	uint8_t neg = 0;
+
+	if (a < 0) a += TRIG_DEG(360);
+	if (a >= TRIG_DEG(180)) {
+		a -= TRIG_DEG(180);
+		neg = 1;
+	}
+	if (a > TRIG_DEG(90)) a = TRIG_DEG(180) - a;
+
+	deg = a >> 8;
+	frac = a & 0xFF;
+	v = sin_table[deg];
+	if (frac) v += ((sin_table[deg+1] - v) * frac + 128) >> 8;
+
+	return (neg) ? -v : v;
+}
+
+//==============================
+int16_t trig_cos(int32_t angle)
+{
+	return trig_sin(angle + TRIG_DEG(90));
+}
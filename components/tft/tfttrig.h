@@ -0,0 +1,25 @@
+/*
+ *
+ * FIXED POINT SINE AND COSINE FOR ANGLE BASED DRAWING FUNCTIONS
+ *
+*/
+
+#ifndef _TFTTRIG_H_
+#define _TFTTRIG_H_
+
+#include <stdint.h>
+
+// Angles are given in 1/256 degree units, results are Q15 (32767 = 1.0)
+#define TRIG_ONE		32767
+// Convert angle in degrees (integer or float) to trig angle units
+#define TRIG_DEG(deg)	((int32_t)((deg) * 256))
+// Multiply 'v' by Q15 value 't', rounded to nearest integer
+#define TRIG_MUL(v, t)	((int32_t)(((int32_t)(v) * (int32_t)(t) + 16384) >> 15))
+
+// Sine of 'angle', any angle is accepted, max error is about 2 LSB
+int16_t trig_sin(int32_t angle);
+
+// Cosine of 'angle'
+int16_t trig_cos(int32_t angle);
+
+#endif
@@ -4,6 +4,7 @@
 #include "client.h"
 
 // cstdlib includes
+#include <stdio.h>
 #include <string.h>
 
 // ESP-IDF includes
@@ -12,16 +13,40 @@
 #include "sdkconfig.h"
 #include "tcpip_adapter.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include <lwip/netdb.h>
 
+// STATS includes
+#include "stats/stats.h"
+
 /****************************************************************
  * Defines, consts
  ****************************************************************/
 #define PORT			(4567)
-#define UDP_PACKET_SIZE	(1450)
+#define RECV_TIMEOUT_MS	(1000)
+
+// Framed transport: the request is sent as "framed <tag> <request>" and every
+// response datagram starts with a header (little endian):
+//   uint16 magic		FRAMED_MAGIC
+//   uint16 tag			tag of the request this packet answers
+//   uint32 offset		payload offset in the response, a multiple of FRAMED_CHUNK_SIZE
+//   uint32 total		total response length
+//   uint16 length		payload length, FRAMED_CHUNK_SIZE except for the last chunk
+//   uint16 reserved
+// Chunks may arrive in any order. Missing chunks are re-requested with
+// "resend <tag> <first>-<last>,..." listing chunk index ranges.
+// Responses the server pushes unrequested have FRAMED_PUSH_TAG set in their tag,
+// the rest of it counting up from one pushed response to the next, from any value
+// after the device subscribes (see WebClient_ResetPush).
+#define FRAMED_MAGIC			(0x4C46)
+#define FRAMED_PUSH_TAG			(0x8000)
+#define FRAMED_TIMEOUT_MS		(100)
+#define FRAMED_MAX_RESENDS		(5)
 
 /****************************************************************
  * Local variables
@@ -31,6 +56,27 @@ uint8_t addr_family;
 uint8_t ip_protocol;
 int32_t sock;
 struct sockaddr_in dest_addr;
+uint16_t framedTag = 0;
+uint16_t pushTag = 0;
+// Held while a request is waiting for its response or a framed response is open, so
+// one task (e.g. a button handler) never reads packets meant for another
+SemaphoreHandle_t sockMutex = NULL;
+uint32_t framedMoves = 0;
+
+/****************************************************************
+ * Function declarations
+ ****************************************************************/
+void WebClient_SetTimeout(uint32_t timeoutMs);
+
+bool WebClient_GetLocked(char * request, size_t bufferSize, char * buffer);
+
+bool WebClient_IsFramed(char * packet, int len);
+
+bool WebClient_RequestResend(uint16_t tag, uint32_t * chunkMap, uint32_t chunkCount);
+
+uint32_t WebClient_NextMissing(uint32_t * chunkMap, uint32_t chunkCount, uint32_t last);
+
+bool WebClient_NewerPush(uint16_t tag);
 
 /****************************************************************
  * Function definitions
@@ -44,17 +90,56 @@ bool WebClient_Init(char * ip)
 	ip_protocol = IPPROTO_IP;
 	inet_ntoa_r(dest_addr.sin_addr, addr_str, sizeof(addr_str) - 1);
 
+	sockMutex = xSemaphoreCreateMutex();
+	if (sockMutex == NULL) return false;
+
 	sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
 	if (sock < 0) return false;
 
+	WebClient_SetTimeout(RECV_TIMEOUT_MS);
+
+	return true;
+}
+
+void WebClient_SetTimeout(uint32_t timeoutMs)
+{
 	struct timeval to;
-	to.tv_sec = 1;
+	to.tv_sec = timeoutMs / 1000;
+	to.tv_usec = (timeoutMs % 1000) * 1000;
 	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &to, sizeof(to));
+}
 
-	return true;
+bool WebClient_Send(char * message)
+{
+	bool result;
+
+	xSemaphoreTake(sockMutex, portMAX_DELAY);
+	result = sendto(sock, message, strlen(message), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) >= 0;
+	xSemaphoreGive(sockMutex);
+	return result;
 }
 
 bool WebClient_Get(char * request, size_t bufferSize, char * buffer)
+{
+	bool result;
+
+	xSemaphoreTake(sockMutex, portMAX_DELAY);
+	result = WebClient_GetLocked(request, bufferSize, buffer);
+	xSemaphoreGive(sockMutex);
+	return result;
+}
+
+// True if a packet is part of a framed response, e.g. one pushed while waiting for another answer
+bool WebClient_IsFramed(char * packet, int len)
+{
+	uint16_t magic;
+
+	if (len < sizeof(magic)) return false;
+	memcpy(&magic, packet, sizeof(magic));
+	return (magic == FRAMED_MAGIC);
+}
+
+bool WebClient_GetLocked(char * request, size_t bufferSize, char * buffer)
 {
 	//ESP_LOGI("WebClient", "Sending request %s.", request);
 	uint32_t startTime = xTaskGetTickCount();
@@ -68,7 +153,11 @@ bool WebClient_Get(char * request, size_t bufferSize, char * buffer)
 	int totalLen = 0;
 	if (bufferSize <= UDP_PACKET_SIZE)
 	{
-		totalLen = lwip_read(sock, buffer, bufferSize);
+		// Pushed frame packets are dropped, the grabber asks for them again
+		do
+		{
+			totalLen = lwip_read(sock, buffer, bufferSize);
+		} while (WebClient_IsFramed(buffer, totalLen));
 	}
 	else
 	{
@@ -95,3 +184,264 @@ bool WebClient_Get(char * request, size_t bufferSize, char * buffer)
 	//ESP_LOGI("WebClient", "Got response of %d bytes in %dms.", totalLen, (xTaskGetTickCount() - startTime) * portTICK_PERIOD_MS);
 	return true;
 }
+
+// Asks the server for every chunk not yet marked in chunkMap
+bool WebClient_RequestResend(uint16_t tag, uint32_t * chunkMap, uint32_t chunkCount)
+{
+	char request[FRAMED_REQUEST_SIZE];
+	int pos = snprintf(request, sizeof(request), "resend %u ", tag);
+	uint32_t first;
+	uint32_t i = 0;
+	bool any = false;
+
+	while (i < chunkCount)
+	{
+		if (chunkMap[i / 32] & (1u << (i % 32)))
+		{
+			i++;
+			continue;
+		}
+
+		// Collect a range of missing chunks
+		first = i;
+		while ((i < chunkCount) && !(chunkMap[i / 32] & (1u << (i % 32)))) i++;
+
+		// Leave the rest for the next round if the request is full
+		if ((pos + 24) >= sizeof(request)) break;
+		pos += snprintf(&request[pos], sizeof(request) - pos, "%s%u-%u", any ? "," : "", first, i - 1);
+		any = true;
+	}
+
+	if (!any) return true;
+	Stats_Add(STATS_COUNTER_RESENDS, 1);
+	return sendto(sock, request, pos, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) >= 0;
+}
+
+// Returns the index of the first chunk after 'last' not yet received, wrapping around
+uint32_t WebClient_NextMissing(uint32_t * chunkMap, uint32_t chunkCount, uint32_t last)
+{
+	uint32_t i;
+	uint32_t chunk;
+
+	for (i = 1; i <= chunkCount; i++)
+	{
+		chunk = (last + i) % chunkCount;
+		if (!(chunkMap[chunk / 32] & (1u << (chunk % 32)))) return chunk;
+	}
+	return 0;
+}
+
+bool WebClient_GetFramed(char * request, size_t bufferSize, char * buffer, size_t * received)
+{
+	framed_stream_t stream;
+
+	if (WebClient_OpenFramed(&stream, request, bufferSize, buffer) == false) return false;
+	while ((WebClient_FramedDone(&stream) == false) && WebClient_PumpFramed(&stream));
+	return WebClient_CloseFramed(&stream, received);
+}
+
+bool WebClient_OpenFramed(framed_stream_t * stream, char * request, size_t bufferSize, char * buffer)
+{
+	xSemaphoreTake(sockMutex, portMAX_DELAY);
+	memset(stream, 0, sizeof(framed_stream_t));
+	stream->buffer = buffer;
+	stream->bufferSize = bufferSize;
+	stream->startTime = Stats_Now();
+	framedTag = (framedTag + 1) & ~FRAMED_PUSH_TAG;
+	stream->tag = framedTag;
+	stream->framedLen = snprintf(stream->framed, sizeof(stream->framed), "framed %u %s", stream->tag, request);
+	if ((stream->framedLen < 0) || (stream->framedLen >= sizeof(stream->framed)) ||
+			(sendto(sock, stream->framed, stream->framedLen, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0))
+	{
+		xSemaphoreGive(sockMutex);
+		return false;
+	}
+
+	WebClient_SetTimeout(FRAMED_TIMEOUT_MS);
+	return true;
+}
+
+bool WebClient_ListenFramed(framed_stream_t * stream, size_t bufferSize, char * buffer)
+{
+	xSemaphoreTake(sockMutex, portMAX_DELAY);
+	memset(stream, 0, sizeof(framed_stream_t));
+	stream->buffer = buffer;
+	stream->bufferSize = bufferSize;
+	stream->startTime = Stats_Now();
+	stream->listen = true;
+
+	WebClient_SetTimeout(FRAMED_TIMEOUT_MS);
+	return true;
+}
+
+void WebClient_ResetPush()
+{
+	pushTag = 0;
+}
+
+// True if a pushed tag is later than the last pushed response received, so late packets of old ones are dropped;
+// any pushed tag is accepted after WebClient_ResetPush
+bool WebClient_NewerPush(uint16_t tag)
+{
+	uint16_t ahead = (tag - pushTag) & ~FRAMED_PUSH_TAG;
+
+	if (!(tag & FRAMED_PUSH_TAG)) return false;
+	if (pushTag == 0) return true;
+	return (ahead > 0) && (ahead < (FRAMED_PUSH_TAG / 2));
+}
+
+bool WebClient_FramedDone(framed_stream_t * stream)
+{
+	return (stream->chunkCount > 0) && (stream->chunksLeft == 0);
+}
+
+// Receives one packet, or handles a timeout; returns false once the response has failed.
+// Payloads are scattered by recvmsg straight into the chunk expected next,
+// so in-order packets never pass through an intermediate buffer. A packet
+// for another chunk is moved into place; the expected chunk is one not yet
+// received, so landing there never overwrites good data.
+bool WebClient_PumpFramed(framed_stream_t * stream)
+{
+	char * buffer = stream->buffer;
+	struct iovec iov[3];
+	struct msghdr msg;
+	uint32_t landed;
+	uint32_t offset;
+	uint32_t totalField;
+	uint16_t magic, tag, length;
+	uint64_t moveStart;
+	int len;
+
+	if (stream->failed) return false;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 3;
+	iov[0].iov_base = stream->header;
+	iov[0].iov_len = sizeof(stream->header);
+
+	// Payload goes to the expected chunk, anything past the buffer end to the spill area
+	offset = stream->expected * FRAMED_CHUNK_SIZE;
+	landed = ((stream->bufferSize - offset) < FRAMED_CHUNK_SIZE) ? (stream->bufferSize - offset) : FRAMED_CHUNK_SIZE;
+	iov[1].iov_base = buffer + offset;
+	iov[1].iov_len = landed;
+	iov[2].iov_base = stream->spill;
+	iov[2].iov_len = FRAMED_CHUNK_SIZE - landed;
+
+	len = lwip_recvmsg(sock, &msg, 0);
+	if (len < 0)
+	{
+		// Timed out, repeat the request if nothing arrived, otherwise ask for the missing chunks
+		if (stream->listen && (stream->chunkCount == 0))
+		{
+			// Nothing pushed
+			stream->failed = true;
+		}
+		else if (++stream->resends > FRAMED_MAX_RESENDS)
+		{
+			ESP_LOGE("WebClient", "Framed read failed, %u of %u chunks missing", stream->chunksLeft, stream->chunkCount);
+			stream->failed = true;
+		}
+		else if (stream->chunkCount == 0)
+		{
+			if (sendto(sock, stream->framed, stream->framedLen, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) stream->failed = true;
+		}
+		else if (WebClient_RequestResend(stream->tag, stream->chunkMap, stream->chunkCount) == false)
+		{
+			stream->failed = true;
+		}
+		return !stream->failed;
+	}
+	if (len < FRAMED_HEADER_SIZE) return true;
+
+	char * payload = (char *)iov[1].iov_base;
+	memcpy(&magic, &stream->header[0], sizeof(magic));
+	memcpy(&tag, &stream->header[2], sizeof(tag));
+	memcpy(&offset, &stream->header[4], sizeof(offset));
+	memcpy(&totalField, &stream->header[8], sizeof(totalField));
+	memcpy(&length, &stream->header[12], sizeof(length));
+
+	// Drop foreign packets and late answers to earlier requests
+	if (magic != FRAMED_MAGIC) return true;
+	if (stream->listen && (stream->chunkCount == 0))
+	{
+		if (WebClient_NewerPush(tag) == false) return true;
+		stream->tag = tag;
+		stream->startTime = Stats_Now();
+	}
+	if (tag != stream->tag) return true;
+	if ((length != (len - FRAMED_HEADER_SIZE)) || (offset % FRAMED_CHUNK_SIZE)) return true;
+
+	if (stream->chunkCount == 0)
+	{
+		if ((totalField == 0) || (totalField > stream->bufferSize)) stream->failed = true;
+		stream->total = totalField;
+		stream->chunkCount = (stream->total + FRAMED_CHUNK_SIZE - 1) / FRAMED_CHUNK_SIZE;
+		if (stream->chunkCount > FRAMED_MAX_CHUNKS) stream->failed = true;
+		if (stream->failed) return false;
+		stream->chunksLeft = stream->chunkCount;
+	}
+	if ((totalField != stream->total) || ((offset + length) > stream->total)) return true;
+	if ((length != FRAMED_CHUNK_SIZE) && ((offset + length) != stream->total)) return true;
+
+	uint32_t chunk = offset / FRAMED_CHUNK_SIZE;
+	if (stream->chunkMap[chunk / 32] & (1u << (chunk % 32))) return true;	// duplicate
+
+	if ((payload != (buffer + offset)) || (length > landed))
+	{
+		// Not the chunk we expected, move it into place
+		moveStart = Stats_Now();
+		framedMoves++;
+		size_t head = (length < landed) ? length : landed;
+		memmove(buffer + offset, payload, head);
+		if (length > head) memcpy(buffer + offset + head, stream->spill, length - head);
+		stream->moveTime += Stats_Now() - moveStart;
+	}
+	stream->chunkMap[chunk / 32] |= (1u << (chunk % 32));
+
+	// Extend the part that can be read in order
+	while (stream->ready < stream->total)
+	{
+		chunk = stream->ready / FRAMED_CHUNK_SIZE;
+		if (!(stream->chunkMap[chunk / 32] & (1u << (chunk % 32)))) break;
+		stream->ready = ((stream->ready + FRAMED_CHUNK_SIZE) < stream->total) ? (stream->ready + FRAMED_CHUNK_SIZE) : stream->total;
+	}
+
+	if (--stream->chunksLeft > 0)
+	{
+		stream->expected = WebClient_NextMissing(stream->chunkMap, stream->chunkCount, offset / FRAMED_CHUNK_SIZE);
+	}
+	return true;
+}
+
+size_t WebClient_ReadFramed(framed_stream_t * stream, char * data, size_t length)
+{
+	while ((stream->ready < (stream->position + length)) && (WebClient_FramedDone(stream) == false))
+	{
+		if (WebClient_PumpFramed(stream) == false) return 0;
+	}
+
+	if (length > (stream->ready - stream->position)) length = stream->ready - stream->position;
+	if (data) memcpy(data, stream->buffer + stream->position, length);
+	stream->position += length;
+	return length;
+}
+
+bool WebClient_CloseFramed(framed_stream_t * stream, size_t * received)
+{
+	WebClient_SetTimeout(RECV_TIMEOUT_MS);
+	if (stream->listen && (stream->chunkCount > 0)) pushTag = stream->tag;
+	xSemaphoreGive(sockMutex);
+	if (WebClient_FramedDone(stream) == false) return false;
+
+	*received = stream->total;
+	Stats_RecordSince(STATS_STAGE_RECEIVE, stream->startTime);
+	Stats_Record(STATS_STAGE_REASSEMBLY, (uint32_t)stream->moveTime);
+	Stats_Add(STATS_COUNTER_RX_BYTES, stream->total);
+	return true;
+}
+
+uint32_t WebClient_GetFramedMoves()
+{
+	return framedMoves;
+}
@@ -9,6 +9,15 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+/****************************************************************
+ * Defines, consts
+ ****************************************************************/
+#define UDP_PACKET_SIZE			(1450)
+#define FRAMED_HEADER_SIZE		(16)
+#define FRAMED_CHUNK_SIZE		(UDP_PACKET_SIZE - FRAMED_HEADER_SIZE)
+#define FRAMED_MAX_CHUNKS		(256)
+#define FRAMED_REQUEST_SIZE		(128)
+
 /****************************************************************
  * Typedefs, structs, enums
  ****************************************************************/
@@ -19,11 +28,70 @@ typedef struct kvp
 } kvp_t;
 typedef struct kvp header_t;
 
+// A framed response being received, read in order while later chunks are still arriving
+typedef struct
+{
+	char * buffer;
+	size_t bufferSize;
+	char framed[FRAMED_REQUEST_SIZE];
+	int framedLen;
+	char header[FRAMED_HEADER_SIZE];
+	char spill[FRAMED_CHUNK_SIZE];
+	uint32_t chunkMap[FRAMED_MAX_CHUNKS / 32];
+	uint32_t chunkCount;
+	uint32_t chunksLeft;
+	uint32_t total;
+	uint32_t expected;		// chunk the next packet is received into
+	uint32_t ready;			// bytes received in order from the start
+	uint32_t position;		// bytes already read
+	uint16_t tag;
+	uint8_t resends;
+	bool listen;			// pushed response, tag taken from its first packet
+	bool failed;
+	uint64_t startTime;
+	uint64_t moveTime;
+} framed_stream_t;
+
 /****************************************************************
  * Function declarations
  ****************************************************************/
 bool WebClient_Init();
 
+// Send a message without waiting for a response
+bool WebClient_Send(char * message);
+
 bool WebClient_Get(char * request, size_t bufferSize, char * buffer);
 
+// Receive a response over the framed transport, reassembling out of order
+// chunks and re-requesting lost ones; 'received' is set to the response length
+bool WebClient_GetFramed(char * request, size_t bufferSize, char * buffer, size_t * received);
+
+// Send a framed request, its response is reassembled into 'buffer'
+// On success the socket is held until WebClient_CloseFramed
+bool WebClient_OpenFramed(framed_stream_t * stream, char * request, size_t bufferSize, char * buffer);
+
+// Wait for the next response pushed by the server, reassembled into 'buffer'; if no
+// packet of it arrives within one framed timeout the stream fails with chunkCount still 0
+// The socket is held until WebClient_CloseFramed
+bool WebClient_ListenFramed(framed_stream_t * stream, size_t bufferSize, char * buffer);
+
+// Forget the last pushed response, call when subscribing as the server may start its push tags over
+void WebClient_ResetPush();
+
+// True once the whole response has arrived
+bool WebClient_FramedDone(framed_stream_t * stream);
+
+// Receive one packet of the response, false once it has failed
+bool WebClient_PumpFramed(framed_stream_t * stream);
+
+// Read the next 'length' bytes of the response (skip them if 'data' is NULL),
+// waiting only until they have arrived; returns the number of bytes read, 0 at the end or on failure
+size_t WebClient_ReadFramed(framed_stream_t * stream, char * data, size_t length);
+
+// Finish a framed response, true if it arrived completely
+bool WebClient_CloseFramed(framed_stream_t * stream, size_t * received);
+
+// Number of framed packets that did not land in place and had to be moved
+uint32_t WebClient_GetFramedMoves();
+
 #endif /* WEBCLIENT_CLIENT_H_ */
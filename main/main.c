@@ -211,7 +211,7 @@ bool TFT_Init()
 		.sclk_io_num = PIN_NUM_CLK,
 		.quadwp_io_num = -1,
 		.quadhd_io_num = -1,
-		.max_transfer_sz = 6 * 1024
+		.max_transfer_sz = DEFAULT_TFT_DISPLAY_WIDTH * DEFAULT_TFT_DISPLAY_HEIGHT * 3	// whole frame in one DMA chain
 	};
 	spi_lobo_device_interface_config_t devcfg =
 	{
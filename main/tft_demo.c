@@ -19,6 +19,7 @@
 #include "driver/gpio.h"
 #include "esp_system.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "tftspi.h"
 #include "tft.h"
 
@@ -929,6 +930,160 @@ static void touch_demo()
 }
 
 
+// Benchmark of the drawing primitives
+// Every primitive is drawn a fixed number of times with the same (seeded) parameters,
+// average time and display spi traffic per call are printed for comparing driver changes
+#define BENCH_ITERATIONS 50
+
+static int64_t bench_time;
+
+//--------------------------
+static void bench_start() {
+	srand(1);
+	TFT_resetSpiCost();
+	bench_time = esp_timer_get_time();
+}
+
+//----------------------------------------
+static void bench_end(const char *name) {
+	tft_spi_cost_t cost;
+	int64_t t = esp_timer_get_time() - bench_time;
+
+	TFT_getSpiCost(&cost);
+	printf("%-14s %8u us %6u cmd %6u win %8u bytes %6u trans\r\n", name, (uint32_t)(t / BENCH_ITERATIONS),
+			cost.commands / BENCH_ITERATIONS, cost.windows / BENCH_ITERATIONS,
+			cost.data_bytes / BENCH_ITERATIONS, cost.transactions / BENCH_ITERATIONS);
+}
+
+//------------------------
+static void bench_demo() {
+	int n, x, y;
+	int cx = (dispWin.x2 - dispWin.x1) / 2;
+	int cy = (dispWin.y2 - dispWin.y1) / 2;
+	int r = ((cx < cy) ? cx : cy) - 2;
+
+	if (!doprint) return;
+	disp_header("BENCHMARK");
+	printf("\r\n==== Benchmark, averages over %d calls ====\r\n", BENCH_ITERATIONS);
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_fillWindow(random_color());
+	bench_end("fillWindow");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) {
+		x = rand_interval(0, dispWin.x2);
+		y = rand_interval(0, dispWin.y2);
+		TFT_drawPixel(x, y, random_color(), 1);
+	}
+	bench_end("drawPixel");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) {
+		TFT_drawLine(rand_interval(0, dispWin.x2), rand_interval(0, dispWin.y2),
+				rand_interval(0, dispWin.x2), rand_interval(0, dispWin.y2), random_color());
+	}
+	bench_end("drawLine");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) {
+		tft_point_t line[16];
+		for (int i=0; i<16; i++) {
+			line[i].x = rand_interval(0, dispWin.x2);
+			line[i].y = rand_interval(0, dispWin.y2);
+		}
+		TFT_drawPolyline(line, 16, random_color());
+	}
+	bench_end("drawPolyline (16)");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_drawCircle(cx, cy, rand_interval(4, r), random_color());
+	bench_end("drawCircle");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_fillCircle(cx, cy, rand_interval(4, r), random_color());
+	bench_end("fillCircle");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_fillEllipse(cx, cy, rand_interval(4, cx), rand_interval(4, cy), random_color(), 15);
+	bench_end("fillEllipse");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) {
+		TFT_fillTriangle(rand_interval(0, dispWin.x2), rand_interval(0, dispWin.y2),
+				rand_interval(0, dispWin.x2), rand_interval(0, dispWin.y2),
+				rand_interval(0, dispWin.x2), rand_interval(0, dispWin.y2), random_color());
+	}
+	bench_end("fillTriangle");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_fillRoundRect(4, 4, cx, cy, 8, random_color());
+	bench_end("fillRoundRect");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) {
+		TFT_drawArc(cx, cy, r, 10, rand_interval(0, 180), rand_interval(180, 360), random_color(), random_color());
+	}
+	bench_end("drawArc");
+
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_drawPolygon(cx, cy, 6, r, random_color(), random_color(), n, 1);
+	bench_end("drawPolygon");
+
+	TFT_setFont(DEFAULT_FONT, NULL);
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_print("Benchmark 0123", 0, rand_interval(0, dispWin.y2-16));
+	bench_end("print");
+
+	TFT_setFont(DEJAVU24_FONT, NULL);
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) TFT_print("Bench 0123", 0, rand_interval(0, dispWin.y2-24));
+	bench_end("print (24px)");
+
+	glyph_cache_stats_t gc;
+	TFT_getGlyphCacheStats(&gc);
+	printf("glyph cache    %u hits %u misses %u evictions %u bytes\r\n", gc.hits, gc.misses, gc.evictions, gc.bytes);
+
+	// String width of every bundled proportional font, no display traffic
+	const uint8_t bench_fonts[] = {DEJAVU18_FONT, DEJAVU24_FONT, UBUNTU16_FONT, COMIC24_FONT, MINYA24_FONT, TOONEY32_FONT};
+	const char *bench_font_names[] = {"width dejavu18", "width dejavu24", "width ubuntu16", "width comic24", "width minya24", "width tooney32"};
+	for (int f=0; f<sizeof(bench_fonts); f++) {
+		TFT_setFont(bench_fonts[f], NULL);
+		bench_start();
+		for (n=0; n<BENCH_ITERATIONS; n++) TFT_getStringWidth("The quick brown fox jumps over the lazy dog 0123456789");
+		bench_end(bench_font_names[f]);
+	}
+
+	// Mixed text and shapes, drawn directly and through the shadow framebuffer
+	TFT_setFont(DEFAULT_FONT, NULL);
+	bench_start();
+	for (n=0; n<BENCH_ITERATIONS; n++) {
+		TFT_fillCircle(cx, cy, rand_interval(4, r), random_color());
+		TFT_drawRoundRect(4, 4, cx, cy, 8, random_color());
+		TFT_print("Shadow 0123", 0, rand_interval(0, dispWin.y2-16));
+	}
+	bench_end("mixed");
+
+	if (TFT_setShadow(1) == ESP_OK) {
+		bench_start();
+		for (n=0; n<BENCH_ITERATIONS; n++) {
+			TFT_fillCircle(cx, cy, rand_interval(4, r), random_color());
+			TFT_drawRoundRect(4, 4, cx, cy, 8, random_color());
+			TFT_print("Shadow 0123", 0, rand_interval(0, dispWin.y2-16));
+			TFT_flush();
+		}
+		bench_end("mixed (shadow)");
+		TFT_setShadow(0);
+	}
+
+	tft_pool_stats_t ps;
+	TFT_getPoolStats(&ps);
+	printf("dma pool       %u/%u blocks in use, high water %u, %u leases %u heap fallbacks\r\n",
+			ps.used, ps.blocks, ps.high_water, ps.leases, ps.fallbacks);
+
+	Wait(GDEMO_INFO_TIME);
+}
+
 //===============
 void tft_demo() {
 
@@ -1021,6 +1176,7 @@ void tft_demo() {
 		disp_header("Welcome to ESP32");
 
 		test_times();
+		bench_demo();
 		font_demo();
 		line_demo();
 		aline_demo();